@@ -25,7 +25,7 @@ using math::power4;
 class infinite_worker : public alps::parapack::mc_worker {
 private:
   typedef alps::parapack::mc_worker super_type;
-  typedef cluster::union_find::node fragment_t;
+  typedef cluster::union_find::node_array<> fragments_t;
 
 public:
   infinite_worker(alps::Parameters const& params) :
@@ -60,7 +60,7 @@ public:
     ++mcs;
 
     // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
+    reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
     // cluster generation
     for (double t = r_time(); t < 1; t += r_time()) {
@@ -68,19 +68,18 @@ public:
       int s1 = lattice.num_sites() * uniform_01();
       if (spins[s0] == spins[s1]) unify(fragments, s0, s1);
     }
+    update_weight(fragments); // no-op unless unify policy does not maintain weight
 
     // assign cluster id & accumulate cluster properties
-    int nc = 0;
+    int nc = assign_id(fragments);
     double mag2 = 0, mag4 = 0;
-    BOOST_FOREACH(fragment_t& f, fragments) {
-      if (f.is_root()) {
-        f.set_id(nc++);
-        double w = f.weight();
+    for (int s = 0; s < lattice.num_sites(); ++s) {
+      if (fragments[s].is_root()) {
+        double w = fragments[s].weight();
         mag2 += power2(w);
         mag4 += power4(w);
       }
     }
-    BOOST_FOREACH(fragment_t& f, fragments) f.set_id(cluster_id(fragments, f));
 
     // flip spins
     for (int c = 0; c < nc; ++c) flip[c] = (uniform_01() < 0.5);
@@ -107,7 +106,7 @@ private:
   boost::variate_generator<engine_type&, boost::exponential_distribution<> > r_time;
   alps::mc_steps mcs;
   std::vector<int> spins; // spin configuration
-  std::vector<fragment_t> fragments;
+  fragments_t fragments;
   std::vector<bool> flip;
 };
 
@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <vector>
 #include <standards/power.hpp>
+#include <cluster/bernoulli.hpp>
 #include <cluster/union_find.hpp>
 
 using math::power2;
@@ -23,11 +24,13 @@ class percolation_site_worker : public alps::parapack::mc_worker {
 private:
   typedef alps::parapack::mc_worker super_type;
   typedef alps::graph_helper<>::bond_descriptor bond_descriptor;
-  typedef cluster::union_find::node fragment_t;
+  typedef cluster::union_find::node_array<> fragments_t;
 
 public:
   percolation_site_worker(alps::Parameters const& params) :
     super_type(params), lattice(params), probability(alps::evaluate("PROBABILITY", params)),
+    threshold_bits(params.defined("THRESHOLD_BITS") ?
+                   static_cast<int>(alps::evaluate("THRESHOLD_BITS", params)) : 0),
     mcs(params), occupied(lattice.num_sites()), fragments(lattice.num_sites()) {
   }
   virtual ~percolation_site_worker() {}
@@ -54,23 +57,27 @@ public:
     ++mcs;
 
     // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
+    reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
-    // cluster generation
-    for (int s = 0; s < lattice.num_sites(); ++s) occupied[s] = (uniform_01() < probability);
+    // cluster generation; occupation by integer threshold if THRESHOLD_BITS is given (see
+    // cluster/bernoulli.hpp)
+    cluster::bernoulli coin(probability, threshold_bits);
+    auto occupy = [&] { return threshold_bits ? coin(engine()) : (uniform_01() < probability); };
+    for (int s = 0; s < lattice.num_sites(); ++s) occupied[s] = occupy();
     BOOST_FOREACH(bond_descriptor b, lattice.bonds()) {
       int s0 = lattice.source(b);
       int s1 = lattice.target(b);
       if (occupied[s0] && occupied[s1]) unify(fragments, s0, s1);
     }
+    update_weight(fragments); // no-op unless unify policy does not maintain weight
 
     // accumulate cluster properties
     int nc = 0;
     double wmax = 0, mag2 = 0;
-    BOOST_FOREACH(fragment_t& f, fragments) {
-      if (f.is_root()) {
+    for (int s = 0; s < lattice.num_sites(); ++s) {
+      if (fragments[s].is_root()) {
         ++nc;
-        double w = f.weight();
+        double w = fragments[s].weight();
         wmax = std::max(wmax, w);
         mag2 += power2(w);
       }
@@ -89,7 +96,8 @@ public:
 private:
   alps::graph_helper<> lattice;
   double probability; // occupation probability
+  int threshold_bits; // bits per trial by integer threshold (0 for uniform_01)
   alps::mc_steps mcs;
   std::vector<bool> occupied;
-  std::vector<fragment_t> fragments;
+  fragments_t fragments;
 };
@@ -15,22 +15,32 @@
 #include <algorithm>
 #include <vector>
 #include <standards/power.hpp>
+#include <cluster/bernoulli.hpp>
+#include <cluster/finalize.hpp>
+#include <cluster/potts_spin.hpp>
+#include <cluster/single_cluster.hpp>
 #include <cluster/union_find.hpp>
 
 using math::power2;
-using math::power4;
 
 class potts_worker : public alps::parapack::mc_worker {
 private:
   typedef alps::parapack::mc_worker super_type;
   typedef alps::graph_helper<>::bond_descriptor bond_descriptor;
-  typedef cluster::union_find::node fragment_t;
+  typedef alps::graph_helper<>::site_descriptor site_descriptor;
+  typedef cluster::union_find::node_array<> fragments_t;
+  typedef cluster::potts::spin_type spin_type;
 
 public:
   potts_worker(alps::Parameters const& params) :
     super_type(params), lattice(params), q(alps::evaluate("Q", params)),
-    temperature(alps::evaluate("T", params)), mcs(params), spins(lattice.num_sites(), 0),
-    fragments(lattice.num_sites()), flip(lattice.num_sites()) {
+    temperature(alps::evaluate("T", params)),
+    threshold_bits(params.defined("THRESHOLD_BITS") ?
+                   static_cast<int>(alps::evaluate("THRESHOLD_BITS", params)) : 0),
+    single_cluster(params.defined("SINGLE_CLUSTER") &&
+                   alps::evaluate("SINGLE_CLUSTER", params) != 0),
+    mcs(params), spins(lattice.num_sites(), 0), fragments(single_cluster ? 0 : lattice.num_sites()),
+    flip(lattice.num_sites()), wolff(single_cluster ? lattice.num_sites() : 0) {
   }
   virtual ~potts_worker() {}
 
@@ -58,34 +68,33 @@ public:
 
   void run(alps::ObservableSet& obs) {
     ++mcs;
+    if (single_cluster) {
+      run_single_cluster(obs);
+      return;
+    }
     double prob = 1 - std::exp(-1 / temperature);
 
     // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
+    reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
-    // cluster generation
+    // cluster generation; bond activation by integer threshold if THRESHOLD_BITS is given (see
+    // cluster/bernoulli.hpp)
+    cluster::bernoulli coin(prob, threshold_bits);
+    auto activate = [&] { return threshold_bits ? coin(engine()) : (uniform_01() < prob); };
     BOOST_FOREACH(bond_descriptor b, lattice.bonds()) {
-      if (spins[lattice.source(b)] == spins[lattice.target(b)] && uniform_01() < prob)
+      if (spins[lattice.source(b)] == spins[lattice.target(b)] && activate())
         unify(fragments, lattice.source(b), lattice.target(b));
     }
+    update_weight(fragments); // no-op unless unify policy does not maintain weight
 
-    // assign cluster id & accumulate cluster properties
-    int nc = 0;
-    double mag2 = 0, mag4 = 0;
-    BOOST_FOREACH(fragment_t& f, fragments) {
-      if (f.is_root()) {
-        f.set_id(nc++);
-        double w = f.weight();
-        mag2 += power2(w);
-        mag4 += power4(w);
-      }
-    }
-    BOOST_FOREACH(fragment_t& f, fragments) f.set_id(cluster_id(fragments, f));
-
-    // flip spins
-    for (int c = 0; c < nc; ++c) flip[c] = static_cast<int>(q * uniform_01());
-    for (int s = 0; s < lattice.num_sites(); ++s)
-      spins[s] = (spins[s] + flip[fragments[s].id()]) % q;
+    // assign cluster id, accumulate cluster properties & flip spins
+    cluster::union_find::weight_moments<2, 4> m;
+    int nc;
+    cluster::potts::dispatch(q, [&](auto add) {
+      nc = finalize(fragments, m,
+                    [&](int c, int) { flip[c] = static_cast<spin_type>(q * uniform_01()); },
+                    [&](int s, int c) { spins[s] = add(spins[s], flip[c]); });
+    });
 
     double ene = 0;
     BOOST_FOREACH(bond_descriptor b, lattice.bonds()) {
@@ -99,9 +108,65 @@ public:
     obs["Energy"] << ene;
     obs["Energy Density"] << ene / lattice.num_sites();
     obs["Energy^2"] << ene * ene;
-    obs["Order Parameter Density^2"] << mag2;
+    obs["Order Parameter Density^2"] << m.sum<2>();
     double fc = 2.0 / (q - 1);
-    obs["Order Parameter Density^4"] << ((1 + fc) * power2(mag2) - fc * mag4);
+    obs["Order Parameter Density^4"] << ((1 + fc) * power2(m.sum<2>()) - fc * m.sum<4>());
+  }
+
+  // single-cluster (Wolff) update with SINGLE_CLUSTER = 1; clusters are grown from random sites
+  // and shifted by random nonzero amounts until as many spins as sites are changed (one MC step).
+  // Each configuration before a flip is measured, with improved estimators N c and
+  // (1 + fc) N c X - fc N c^3 for cluster of size c, where X = (q sum_a n_a^2 - N^2) / (q - 1).
+  void run_single_cluster(alps::ObservableSet& obs) {
+    double prob = 1 - std::exp(-1 / temperature);
+    int ns = lattice.num_sites();
+    double fc = 2.0 / (q - 1);
+    cluster::bernoulli coin(prob, threshold_bits);
+    auto activate = [&] { return threshold_bits ? coin(engine()) : (uniform_01() < prob); };
+    auto neighbors = [&](int s, auto const& f) {
+      BOOST_FOREACH(site_descriptor t, lattice.neighbors(s)) f(t);
+    };
+
+    // energy and number of sites in each state, updated by each flip
+    double ene = 0;
+    BOOST_FOREACH(bond_descriptor b, lattice.bonds()) {
+      ene -= (spins[lattice.source(b)] == spins[lattice.target(b)] ? 1.0 : 0.0);
+    }
+    std::vector<double> count(q, 0);
+    for (spin_type s : spins) count[s] += 1;
+
+    int nc = 0;
+    cluster::potts::dispatch(q, [&](auto add) {
+      for (int flipped = 0; flipped < ns; ++nc) {
+        int s0 = static_cast<int>(ns * uniform_01());
+        spin_type sigma = spins[s0];
+        spin_type sigma_new = add(sigma, static_cast<spin_type>(1 + (q - 1) * uniform_01()));
+        double c = wolff.grow(s0, neighbors,
+                              [&](int, int t, int) { return spins[t] == sigma && activate(); });
+        double x = 0;
+        for (double n : count) x += n * n;
+        x = (q * x - power2(double(ns))) / (q - 1);
+        obs["Energy"] << ene;
+        obs["Energy Density"] << ene / ns;
+        obs["Energy^2"] << ene * ene;
+        obs["Order Parameter Density^2"] << ns * c;
+        obs["Order Parameter Density^4"] << ((1 + fc) * ns * c * x - fc * ns * power2(c) * c);
+        for (int s : wolff.members()) {
+          BOOST_FOREACH(site_descriptor t, lattice.neighbors(s)) {
+            if (!wolff.contains(t)) ene += (spins[t] == sigma) - (spins[t] == sigma_new);
+          }
+          spins[s] = sigma_new;
+        }
+        count[sigma] -= c;
+        count[sigma_new] += c;
+        flipped += c;
+      }
+    });
+
+    obs["Number of Sites"] << (double)ns;
+    obs["Temperature"] << temperature;
+    obs["Inverse Temperature"] << 1 / temperature;
+    obs["Number of Clusters"] << (double)nc;
   }
 
   void save(alps::ODump& dp) const { dp << mcs << spins; }
@@ -111,10 +176,13 @@ private:
   alps::graph_helper<> lattice;
   int q; // number of states
   double temperature; // temperature
+  int threshold_bits; // bits per bond trial by integer threshold (0 for uniform_01)
+  bool single_cluster; // Wolff algorithm instead of Swendsen-Wang
   alps::mc_steps mcs;
-  std::vector<int> spins; // spin configuration
-  std::vector<fragment_t> fragments;
-  std::vector<int> flip;
+  std::vector<spin_type> spins; // spin configuration
+  fragments_t fragments;
+  std::vector<spin_type> flip;
+  cluster::single_cluster wolff;
 };
 
 class potts_evaluator : public alps::parapack::simple_evaluator {
@@ -0,0 +1,85 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Benchmark of array-of-structures (std::vector<node>) and structure-of-arrays (forest) layouts
+// in Swendsen-Wang cluster generation for hypercubic Ising model at critical temperature
+
+#ifndef ALPS_INDEP_SOURCE
+# define ALPS_INDEP_SOURCE
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <standards/timer.hpp>
+#include <lattice/graph.hpp>
+#include <cluster/union_find.hpp>
+
+// returns number of clusters summed over sweeps, so that both layouts can be cross-checked
+template<typename FRAGMENTS>
+double run(lattice::graph const& lattice, double temperature, unsigned int sweeps,
+           FRAGMENTS& fragments, double& elapsed) {
+  using namespace cluster::union_find;
+  double prob = 1 - std::exp(-2 / temperature);
+  std::mt19937 eng(29833);
+  std::uniform_real_distribution<> r_uniform01;
+  int n = lattice.num_sites();
+  int nb = lattice.num_bonds();
+  std::vector<int> spins(n, 1);
+  std::vector<int> flip(n);
+  double nc_total = 0;
+  standards::timer tm;
+  for (unsigned int mcs = 0; mcs < sweeps; ++mcs) {
+    for (int s = 0; s < n; ++s) fragments[s] = node();
+    for (int b = 0; b < nb; ++b) {
+      if (spins[lattice.source(b)] == spins[lattice.target(b)] && r_uniform01(eng) < prob)
+        unify(fragments, lattice.source(b), lattice.target(b));
+    }
+    int nc = assign_id(fragments);
+    for (int c = 0; c < nc; ++c) flip[c] = (r_uniform01(eng) < 0.5);
+    for (int s = 0; s < n; ++s)
+      if (flip[fragments[s].id()]) spins[s] ^= 1;
+    nc_total += nc;
+  }
+  elapsed = tm.elapsed();
+  return nc_total;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 3 || (argc > 1 && argv[1][0] == '-')) {
+    std::cerr << "Usage: " << argv[0] << " [length_2d [length_3d]]\n";
+    return 127;
+  }
+  unsigned int length[2] = { 1024, 96 };
+  if (argc > 1) length[0] = std::atoi(argv[1]);
+  if (argc > 2) length[1] = std::atoi(argv[2]);
+  double tc[2] = { 2.269185, 4.511524 };
+  unsigned int sweeps = 16;
+
+  for (int d = 2; d <= 3; ++d) {
+    auto lattice = lattice::graph::simple(d, length[d - 2]);
+    std::vector<cluster::union_find::node> aos(lattice.num_sites());
+    cluster::union_find::forest soa(lattice.num_sites());
+    double t_aos, t_soa;
+    double nc_aos = run(lattice, tc[d - 2], sweeps, aos, t_aos);
+    double nc_soa = run(lattice, tc[d - 2], sweeps, soa, t_soa);
+    std::cout << "dimension = " << d << ", length = " << length[d - 2]
+              << ", sites = " << lattice.num_sites() << std::endl
+              << "  AoS (std::vector<node>): " << sweeps / t_aos << " MCS/sec\n"
+              << "  SoA (forest):            " << sweeps / t_soa << " MCS/sec\n";
+    if (nc_aos != nc_soa) {
+      std::cerr << "result mismatch\n";
+      return 127;
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Benchmark of unify() called pair by pair and unify_batch() for random pairs of nodes on a
+// forest much larger than the last-level cache, allocated by std::allocator or
+// huge_page_allocator
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+#include <standards/timer.hpp>
+#include <cluster/huge_page_allocator.hpp>
+#include <cluster/union_find.hpp>
+
+int main(int argc, char* argv[]) {
+  if (argc > 3 || (argc > 1 && argv[1][0] == '-')) {
+    std::cerr << "Usage: " << argv[0] << " [log2_nodes [pairs_per_node]]\n";
+    return 127;
+  }
+  using namespace cluster::union_find;
+  unsigned int log2n = 24;
+  double ratio = 0.5;
+  if (argc > 1) log2n = std::atoi(argv[1]);
+  if (argc > 2) ratio = std::atof(argv[2]);
+  int n = 1 << log2n;
+  std::size_t np = ratio * n;
+
+  std::mt19937 eng(29833);
+  std::uniform_int_distribution<int> r_node(0, n - 1);
+  std::vector<std::pair<int, int> > pairs(np);
+  for (std::size_t i = 0; i < np; ++i) pairs[i] = std::make_pair(r_node(eng), r_node(eng));
+
+  std::vector<node> v0(n), v1(n);
+  std::vector<node, cluster::huge_page_allocator<node> > v2(n), v3(n);
+  standards::timer tm0;
+  for (std::size_t i = 0; i < np; ++i) unify(v0, pairs[i].first, pairs[i].second);
+  double t0 = tm0.elapsed();
+  standards::timer tm1;
+  unify_batch(v1, pairs);
+  double t1 = tm1.elapsed();
+  standards::timer tm2;
+  for (std::size_t i = 0; i < np; ++i) unify(v2, pairs[i].first, pairs[i].second);
+  double t2 = tm2.elapsed();
+  standards::timer tm3;
+  unify_batch(v3, pairs);
+  double t3 = tm3.elapsed();
+  update_weight(v0);
+  update_weight(v1);
+  update_weight(v2);
+  update_weight(v3);
+
+  std::cout << "nodes = " << n << ", pairs = " << np << std::endl
+            << "  unify:                    " << np / t0 / 1e6 << " Mpairs/sec\n"
+            << "  unify_batch:              " << np / t1 / 1e6 << " Mpairs/sec\n"
+            << "  unify (huge pages):       " << np / t2 / 1e6 << " Mpairs/sec\n"
+            << "  unify_batch (huge pages): " << np / t3 / 1e6 << " Mpairs/sec\n";
+  int nc0 = assign_id(v0);
+  int nc1 = assign_id(v1);
+  int nc2 = assign_id(v2);
+  int nc3 = assign_id(v3);
+  if (nc0 != nc1 || nc0 != nc2 || nc0 != nc3) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  for (int i = 0; i < n; ++i) {
+    if (v0[i].id() != v1[i].id() || v0[i].id() != v2[i].id() || v0[i].id() != v3[i].id() ||
+        (v0[i].is_root() && (v0[i].weight() != v1[i].weight() ||
+                             v0[i].weight() != v2[i].weight() ||
+                             v0[i].weight() != v3[i].weight()))) {
+      std::cerr << "result mismatch\n";
+      return 127;
+    }
+  }
+  std::cout << "  clusters = " << nc0 << std::endl;
+}
@@ -0,0 +1,259 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Run-time selection of unify policy and number of threads, and strong-scaling report
+//
+// Unify policy is a template argument, so a Monte Carlo step is written as a generic lambda
+// taking a policy object, and is called through dispatch(name, f).  tuner times a few steps
+// with every candidate (policy x number of threads; number of threads 1 means serial execution,
+// and policies that are not thread-safe are timed with 1 thread only) and returns the fastest
+// one.  The choice is cached per host, parallel backend and key (name of program and its
+// parameters) in the file given by environment variable CLUSTER_AUTOTUNE_CACHE (default:
+// $HOME/.cluster-mc-autotune), and is reused by later runs with the same key.
+//
+// Since dispatch() instantiates the step for every policy it knows, it knows only the default and
+// the thread-safe pathhalving_by_weight, pathhalving_by_index and rem_splicing, unless
+// CLUSTER_AUTOTUNE_ALL_POLICIES is defined at compile time.
+//
+// Example:
+//   auto step = [&](auto policy) { ... unify<decltype(policy)>(fragments, s0, s1); ... };
+//   cluster::autotune::config c = cluster::autotune::tuner("ising L=64 T=2.27").run(step);
+//   cluster::parallel::set_num_threads(c.threads);
+//   cluster::autotune::dispatch(c.policy, [&](auto policy) { ... step(policy) ... });
+
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "parallel.hpp"
+#include "union_find.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <unistd.h>
+#endif
+
+namespace cluster {
+namespace autotune {
+
+struct config {
+  std::string policy; // name of unify policy, or "default" for default_unify_policy
+  int threads;
+};
+
+// call f(policy) with policy object of given name; returns false for unknown name
+template<class F>
+bool dispatch(std::string const& name, F const& f) {
+  using namespace union_find;
+  if (name == "default") f(default_unify_policy());
+  else if (name == "pathhalving_by_weight") f(pathhalving_by_weight());
+  else if (name == "pathhalving_by_index") f(pathhalving_by_index());
+  else if (name == "rem_splicing") f(rem_splicing());
+#ifdef CLUSTER_AUTOTUNE_ALL_POLICIES
+  else if (name == "pathhalving_by_rank") f(pathhalving_by_rank());
+  else if (name == "compress_by_weight") f(compress_by_weight());
+  else if (name == "compress_by_rank") f(compress_by_rank());
+  else if (name == "compress_by_index") f(compress_by_index());
+  else if (name == "link_by_index") f(link_by_index());
+#endif
+  else return false;
+  return true;
+}
+
+// candidate policies known to dispatch(); only those which may unify concurrently if
+// thread_safe_only is true (for parallel labeling)
+inline std::vector<std::string> policy_names(bool thread_safe_only = false) {
+  std::vector<std::string> names;
+  for (std::string name : { "pathhalving_by_weight", "pathhalving_by_rank",
+                            "pathhalving_by_index", "compress_by_weight", "compress_by_rank",
+                            "compress_by_index", "rem_splicing", "link_by_index" }) {
+    dispatch(name, [&](auto policy) {
+      if (!thread_safe_only || decltype(policy)::thread_safe) names.push_back(name);
+    });
+  }
+  return names;
+}
+
+// candidate numbers of threads: 1, 2, 4, ..., and max_threads()
+inline std::vector<int> thread_counts() {
+  int n = parallel::max_threads();
+  std::vector<int> counts;
+  for (int nt = 1; nt < n; nt *= 2) counts.push_back(nt);
+  counts.push_back(n);
+  return counts;
+}
+
+// seconds per call of step(policy), timed for at least min_time seconds after a warm-up call
+template<class F, class P>
+double time_step(F const& step, P policy, double min_time) {
+  typedef std::chrono::steady_clock clock;
+  step(policy); // warm up
+  unsigned int n = 0;
+  double elapsed = 0;
+  auto start = clock::now();
+  do {
+    step(policy);
+    ++n;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < min_time);
+  return elapsed / n;
+}
+
+// print speed of step(policy) for each number of threads, with speedup and parallel efficiency
+// relative to the first one (only for 1 thread if policy is not thread-safe); number of threads
+// is left unchanged
+template<class F>
+void strong_scaling(F const& step, std::string const& policy = "default",
+                    std::vector<int> const& threads = thread_counts(), double min_time = 0.2,
+                    std::ostream& os = std::clog) {
+  int nt_saved = parallel::max_threads();
+  double t_first = 0;
+  dispatch(policy, [&](auto p) {
+    for (int nt : threads) {
+      if (nt > 1 && !decltype(p)::thread_safe) continue;
+      parallel::set_num_threads(nt);
+      double t = time_step(step, p, min_time);
+      if (t_first == 0) t_first = t;
+      double speedup = t_first / t;
+      os << "Strong scaling: threads = " << nt << ": " << 1 / t << " MCS/sec, speedup = "
+         << speedup << ", efficiency = " << speedup * threads.front() / nt << "\n";
+    }
+  });
+  parallel::set_num_threads(nt_saved);
+}
+
+inline std::string host_name() {
+#if defined(__unix__) || defined(__APPLE__)
+  char name[256];
+  if (gethostname(name, sizeof(name)) == 0) {
+    name[sizeof(name) - 1] = '\0';
+    return name;
+  }
+#endif
+  return "localhost";
+}
+
+inline std::string backend_name() {
+#if defined(CLUSTER_USE_THREADS)
+  return "threads";
+#elif defined(_OPENMP)
+  return "openmp";
+#else
+  return "serial";
+#endif
+}
+
+class tuner {
+public:
+  // key should identify program and parameters that affect the choice (e.g. lattice size and
+  // temperature); each candidate is timed for at least min_time seconds
+  explicit tuner(std::string const& key, double min_time = 0.05, std::ostream& os = std::clog) :
+    key_(backend_name() + " max_threads=" + std::to_string(parallel::max_threads()) + " " + key),
+    min_time_(min_time), os_(os) {}
+
+  // step(policy) should perform one Monte Carlo step; number of threads is left unchanged
+  template<class F>
+  config run(F const& step, std::vector<std::string> const& policies = policy_names(),
+             std::vector<int> const& threads = thread_counts()) {
+    config best = { "default", parallel::max_threads() };
+    if (load(best)) {
+      os_ << "Autotune: cached choice = " << best.policy << ", threads = " << best.threads
+          << "\n";
+      return best;
+    }
+    int nt_saved = parallel::max_threads();
+    double best_time = -1;
+    for (auto const& name : policies) {
+      dispatch(name, [&](auto policy) {
+        for (int nt : threads) {
+          if (nt > 1 && !decltype(policy)::thread_safe) continue;
+          parallel::set_num_threads(nt);
+          double t = time_step(step, policy, min_time_);
+          os_ << "Autotune: " << name << ", threads = " << nt << ": " << 1 / t << " MCS/sec\n";
+          if (best_time < 0 || t < best_time) {
+            best_time = t;
+            best.policy = name;
+            best.threads = nt;
+          }
+        }
+      });
+    }
+    parallel::set_num_threads(nt_saved);
+    save(best);
+    os_ << "Autotune: choice = " << best.policy << ", threads = " << best.threads << "\n";
+    return best;
+  }
+
+  static std::string cache_file() {
+    char const* env = std::getenv("CLUSTER_AUTOTUNE_CACHE");
+    if (env) return env;
+    char const* home = std::getenv("HOME");
+    return std::string(home ? home : ".") + "/.cluster-mc-autotune";
+  }
+
+  // cache file contains lines of "host<TAB>key<TAB>policy<TAB>threads"
+  bool load(config& c) const {
+    std::ifstream is(cache_file());
+    std::string line;
+    while (std::getline(is, line)) {
+      std::vector<std::string> fields = split(line);
+      bool thread_safe = false;
+      if (fields.size() == 4 && fields[0] == host_name() && fields[1] == key_ &&
+          dispatch(fields[2], [&](auto p) { thread_safe = decltype(p)::thread_safe; })) {
+        int threads = std::atoi(fields[3].c_str());
+        if (threads == 1 || (threads > 1 && thread_safe)) {
+          c.policy = fields[2];
+          c.threads = threads;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // failure of writing cache is not an error
+  void save(config const& c) const {
+    std::vector<std::string> lines;
+    {
+      std::ifstream is(cache_file());
+      std::string line;
+      while (std::getline(is, line)) {
+        std::vector<std::string> fields = split(line);
+        if (fields.size() < 2 || fields[0] != host_name() || fields[1] != key_)
+          lines.push_back(line);
+      }
+    }
+    lines.push_back(host_name() + '\t' + key_ + '\t' + c.policy + '\t' +
+                    std::to_string(c.threads));
+    std::ofstream os(cache_file());
+    for (auto const& line : lines) os << line << '\n';
+  }
+
+private:
+  static std::vector<std::string> split(std::string const& line) {
+    std::vector<std::string> fields;
+    std::istringstream is(line);
+    std::string field;
+    while (std::getline(is, field, '\t')) fields.push_back(field);
+    return fields;
+  }
+
+  std::string key_;
+  double min_time_;
+  std::ostream& os_;
+};
+
+} // end namespace autotune
+} // end namespace cluster
@@ -0,0 +1,100 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Bernoulli trials by comparing raw bits of engine output with an integer threshold
+//
+// bernoulli(p, bits) rounds p to threshold = round(p 2^bits), and a trial takes the next bits
+// bits of engine output as an integer and succeeds if it is below threshold, i.e. with
+// probability threshold / 2^bits (probability()), which differs from p by at most 2^-(bits+1)
+// (2^-64 for bits = 64 and p close to 1).  Engine output is buffered 64 bits at a time (one call
+// of a 64-bit engine, or two of a 32-bit one), which supply 64 / bits trials, e.g. two for
+// bits = 32 and four for bits = 16.  Neither floating-point conversion nor division is needed,
+// unlike std::uniform_real_distribution<double>, which takes 64 bits and a conversion per trial.
+// bits = 0 falls back to the latter, so that results are the same as uniform01(eng) < p.
+// Unused bits are discarded with the object, which should be owned by a single thread.
+//
+// Example:
+//   cluster::bernoulli active(1 - std::exp(-2 / T), 32);
+//   for (int b = 0; b < nb; ++b)
+//     if (satisfied(b) && active(eng)) unify(fragments, source(b), target(b));
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace cluster {
+
+class bernoulli {
+public:
+  static const int max_bits = 64;
+
+  explicit bernoulli(double p = 0, int bits = 0) :
+    p_(p), bits_(bits), mask_(0), threshold_(0), buffer_(0), left_(0) {
+    if (bits_ <= 0) {
+      bits_ = 0;
+      return;
+    }
+    if (bits_ > max_bits) bits_ = max_bits;
+    mask_ = (bits_ == 64) ? ~std::uint64_t(0) : (std::uint64_t(1) << bits_) - 1;
+    // nearest integer to p 2^bits; 2^64 (bits = 64 and p close to 1) saturates at 2^64 - 1
+    long double t = std::floor(std::ldexp(static_cast<long double>(p), bits_) + 0.5L);
+    if (t <= 0)
+      threshold_ = 0;
+    else if (t >= std::ldexp(1.0L, 64))
+      threshold_ = ~std::uint64_t(0);
+    else
+      threshold_ = static_cast<std::uint64_t>(t);
+  }
+
+  // number of bits per trial (0 for double uniform)
+  int bits() const { return bits_; }
+
+  // actual probability of success
+  double probability() const {
+    return bits_ ? static_cast<double>(std::ldexp(static_cast<long double>(threshold_), -bits_))
+                 : p_;
+  }
+
+  template<class RNG>
+  bool operator()(RNG& eng) {
+    if (bits_ == 0) return std::uniform_real_distribution<>()(eng) < p_;
+    if (left_ < bits_) {
+      buffer_ = draw(eng);
+      left_ = 64;
+    }
+    std::uint64_t r = buffer_ & mask_;
+    buffer_ = (bits_ == 64) ? 0 : (buffer_ >> bits_);
+    left_ -= bits_;
+    return r < threshold_;
+  }
+
+private:
+  // 64 random bits
+  template<class RNG>
+  static std::uint64_t draw(RNG& eng) {
+    std::uint64_t range = static_cast<std::uint64_t>(eng.max() - eng.min());
+    if (range == 0xffffffffu) {
+      std::uint64_t hi = static_cast<std::uint64_t>(eng() - eng.min());
+      return (hi << 32) | static_cast<std::uint64_t>(eng() - eng.min());
+    }
+    if (range == ~std::uint64_t(0)) return static_cast<std::uint64_t>(eng() - eng.min());
+    return std::uniform_int_distribution<std::uint64_t>()(eng);
+  }
+
+  double p_;
+  int bits_;
+  std::uint64_t mask_, threshold_, buffer_;
+  int left_;
+};
+
+} // end namespace cluster
@@ -0,0 +1,174 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Finalization of clusters after cluster generation in two streaming passes over the nodes
+//   1. roots are numbered in index order, and for each root the moments of cluster weight are
+//      accumulated and cluster(c, w) is called with cluster id c and weight w (or cluster(c, w, r)
+//      also with root node r, if it takes three arguments)
+//   2. cluster id is copied to all the nodes (in blocks small enough to stay in cache), and
+//      site(s, c) is called for every node s with its cluster id c
+// This replaces assign_id followed by separate loops over roots, clusters and sites.  finalize
+// runs in the calling thread only, and calls cluster() in order of cluster id (e.g. for drawing
+// random numbers from a single stream).  finalize_parallel numbers roots and copies cluster id in
+// parallel, and calls cluster() and site() concurrently; moments are summed per block of
+// finalize_block_size nodes, so that they do not depend on the number of threads.
+//
+// Example:
+//   cluster::union_find::weight_moments<2, 4> m;
+//   int nc = finalize(fragments, m, [&](int c, int) { flip[c] = (r_uniform01(eng) < 0.5); },
+//                     [&](int s, int c) { if (flip[c]) spins[s] ^= 1; });
+//   ... m.sum<2>() ... m.sum<4>() ...
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "parallel.hpp"
+#include "union_find.hpp"
+
+namespace cluster {
+namespace union_find {
+
+// sums of P-th powers of cluster weight for each P in the list
+template<int... P>
+class weight_moments {
+public:
+  static const int size = sizeof...(P);
+  weight_moments() { std::fill(sum_, sum_ + size + 1, 0.0); }
+  void add(double w) {
+    double pw[] = { power<P>(w)..., 0 };
+    for (int k = 0; k < size; ++k) sum_[k] += pw[k];
+  }
+  void merge(weight_moments const& m) {
+    for (int k = 0; k < size; ++k) sum_[k] += m.sum_[k];
+  }
+  // sum of Q-th power; Q should be one of P
+  template<int Q>
+  double sum() const {
+    static_assert(index(Q) >= 0, "moment not accumulated");
+    return sum_[index(Q)];
+  }
+private:
+  static constexpr int index(int q) {
+    int ps[] = { P..., 0 };
+    for (int k = 0; k < size; ++k) if (ps[k] == q) return k;
+    return -1;
+  }
+  // by squaring, e.g. w^4 = (w^2)^2
+  template<int Q>
+  static double power(double w) {
+    double p = 1;
+    for (int q = Q; q > 0; q >>= 1, w *= w) if (q & 1) p *= w;
+    return p;
+  }
+  double sum_[size + 1];
+};
+
+struct no_callback {
+  template<typename... T>
+  void operator()(T const&...) const {}
+};
+
+// calls cluster(c, w, r) if it takes three arguments, or cluster(c, w) otherwise
+template<class F, typename I>
+auto call_cluster(F const& cluster, I c, I w, I r, int) -> decltype(cluster(c, w, r), void()) {
+  cluster(c, w, r);
+}
+template<class F, typename I>
+void call_cluster(F const& cluster, I c, I w, I, long) { cluster(c, w); }
+
+// number of nodes copied at once in the second pass, and per block of moments in finalize_parallel
+static const int finalize_block_size = 4096;
+
+template<class V, class G>
+void finalize_copy(V& v, index_t<V> first, index_t<V> last, G const& site) {
+  copy_id(v, first, last - first);
+  for (index_t<V> i = first; i < last; ++i) site(i, v[i].id());
+}
+
+// returns number of clusters; moments are added to m
+template<class V, class M, class F, class G>
+index_t<V> finalize(V& v, M& m, F const& cluster, G const& site) {
+  typedef index_t<V> I;
+  I n = v.size();
+  I nc = 0;
+  for (I i = 0; i < n; ++i) {
+    if (v[i].is_root()) {
+      I w = v[i].weight();
+      v[i].set_id(nc);
+      m.add(w);
+      call_cluster(cluster, nc++, w, i, 0);
+    }
+  }
+  for (I first = 0; first < n; first += finalize_block_size)
+    finalize_copy(v, first, std::min(n, first + finalize_block_size), site);
+  return nc;
+}
+
+template<class V, class M, class F>
+index_t<V> finalize(V& v, M& m, F const& cluster) {
+  return finalize(v, m, cluster, no_callback());
+}
+
+template<class V, class M>
+index_t<V> finalize(V& v, M& m) { return finalize(v, m, no_callback(), no_callback()); }
+
+// cluster() and site() may be called concurrently in the thread-safe version
+template<class V, class M, class F, class G>
+index_t<V> finalize_parallel(V& v, M& m, F const& cluster, G const& site) {
+#ifdef CLUSTER_THREAD_SAFE
+  typedef index_t<V> I;
+  I n = v.size();
+  // blocks depend only on the number of nodes
+  I nb = (n + finalize_block_size - 1) / finalize_block_size;
+  auto first = [&](I b) { return std::min(n, b * finalize_block_size); };
+  std::vector<I> offset(nb + 1, 0);
+  std::vector<M> moments(nb);
+  parallel::run([&](int t, int nt) {
+    for (I b = t; b < nb; b += nt)
+      offset[b + 1] = count_root(v, first(b), first(b + 1) - first(b));
+  });
+  for (I b = 0; b < nb; ++b) offset[b + 1] += offset[b];
+  parallel::run([&](int t, int nt) {
+    for (I b = t; b < nb; b += nt) {
+      I c = offset[b];
+      for (I i = first(b); i < first(b + 1); ++i) {
+        if (v[i].is_root()) {
+          I w = v[i].weight();
+          v[i].set_id(c);
+          moments[b].add(w);
+          call_cluster(cluster, c++, w, i, 0);
+        }
+      }
+    }
+  });
+  for (I b = 0; b < nb; ++b) m.merge(moments[b]);
+  parallel::for_each_dynamic(I(0), nb, I(1), [&](I b) {
+    finalize_copy(v, first(b), first(b + 1), site);
+  });
+  return offset[nb];
+#else
+  return finalize(v, m, cluster, site);
+#endif
+}
+
+template<class V, class M, class F>
+index_t<V> finalize_parallel(V& v, M& m, F const& cluster) {
+  return finalize_parallel(v, m, cluster, no_callback());
+}
+
+template<class V, class M>
+index_t<V> finalize_parallel(V& v, M& m) {
+  return finalize_parallel(v, m, no_callback(), no_callback());
+}
+
+} // end namespace union_find
+} // end namespace cluster
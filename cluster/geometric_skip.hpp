@@ -0,0 +1,65 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Geometric skipping of Bernoulli trials
+//
+// Instead of one trial per candidate, geometric_skip(p) draws the number of failures before the
+// next success, k = floor(log(u) / log(1 - p)) for u uniform in (0, 1], which follows the
+// geometric distribution P(k) = (1 - p)^k p.  for_each_success(n, eng, f) calls f(i) for the
+// successful candidates i in [0, n) in increasing order, by about n p + 1 random numbers (and
+// logarithms) instead of n, which pays off for small p.  In Swendsen-Wang algorithm, candidates
+// are the satisfied bonds, which should be compacted into a list first.
+//
+// Example:
+//   int n = 0;
+//   for (int b = 0; b < nb; ++b) { satisfied[n] = b; n += (spins[source(b)] == spins[target(b)]); }
+//   cluster::geometric_skip(1 - std::exp(-2 / T)).for_each_success(n, eng, [&](int i) {
+//     unify(fragments, source(satisfied[i]), target(satisfied[i]));
+//   });
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace cluster {
+
+class geometric_skip {
+public:
+  // returned for p = 0 (or a gap too long to represent)
+  static const std::uint64_t never = std::uint64_t(1) << 62;
+
+  explicit geometric_skip(double p) :
+    p_(p), scale_((p > 0 && p < 1) ? 1 / std::log1p(-p) : 0) {}
+
+  double probability() const { return p_; }
+
+  // number of failures before the next success
+  template<class RNG>
+  std::uint64_t operator()(RNG& eng) const {
+    if (p_ >= 1) return 0;
+    if (p_ <= 0) return never;
+    double k = std::log(1 - std::uniform_real_distribution<>()(eng)) * scale_;
+    return (k < static_cast<double>(never)) ? static_cast<std::uint64_t>(k) : never;
+  }
+
+  template<class RNG, class F>
+  void for_each_success(std::uint64_t n, RNG& eng, F const& f) const {
+    for (std::uint64_t i = (*this)(eng); i < n; i += 1 + (*this)(eng)) f(i);
+  }
+
+private:
+  double p_;
+  double scale_; // 1 / log(1 - p)
+};
+
+} // end namespace cluster
@@ -0,0 +1,228 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Backend-neutral thread-level parallelism used by union_find.hpp
+//
+// Backend is selected at compile time:
+//   CLUSTER_USE_THREADS defined: built-in pool of std::thread (number of threads is given by
+//                                environment variable CLUSTER_NUM_THREADS, or by
+//                                std::thread::hardware_concurrency() if not set)
+//   _OPENMP defined:             OpenMP
+//   otherwise:                   serial
+// CLUSTER_THREAD_SAFE is defined for the first two, and then nodes of union-find are updated
+// atomically.
+//
+// run(f) calls f(t, nt) for t = 0...nt-1 concurrently and waits for all of them.  Calls from
+// inside a parallel region (of the same backend) are executed by the calling thread with nt = 1.
+// Number of threads nt can be changed by set_num_threads() between parallel regions.
+
+#pragma once
+
+#include <cstddef>
+
+#if defined(CLUSTER_USE_THREADS)
+# define CLUSTER_THREAD_SAFE
+# include <atomic>
+# include <condition_variable>
+# include <cstdlib>
+# include <functional>
+# include <mutex>
+# include <thread>
+# include <vector>
+#elif defined(_OPENMP)
+# define CLUSTER_THREAD_SAFE
+# include <atomic>
+# include <omp.h>
+#endif
+
+namespace cluster {
+namespace parallel {
+
+#if defined(CLUSTER_USE_THREADS)
+
+class thread_pool {
+public:
+  explicit thread_pool(int n) : size_(1), active_(1), generation_(0), pending_(0), stop_(false) {
+    resize(n);
+  }
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& w : workers_) w.join();
+  }
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  static thread_pool& instance() {
+    static thread_pool pool(default_size());
+    return pool;
+  }
+  static int default_size() {
+    char const* env = std::getenv("CLUSTER_NUM_THREADS");
+    int n = env ? std::atoi(env) : static_cast<int>(std::thread::hardware_concurrency());
+    return n > 0 ? n : 1;
+  }
+
+  int size() const { return active_; }
+
+  // threads are created on demand and kept idle when n is decreased; should not be called
+  // concurrently with run()
+  void resize(int n) {
+    if (n < 1) n = 1;
+    std::lock_guard<std::mutex> serialize(run_mutex_);
+    for (; size_ < n; ++size_)
+      workers_.emplace_back(&thread_pool::worker, this, size_, generation_);
+    active_ = n;
+  }
+
+  // calling thread works as thread 0; exception thrown by f terminates the program
+  template<class F>
+  void run(F const& f) {
+    if (active_ == 1 || in_region()) {
+      thread_state saved = state();
+      state() = thread_state();
+      f(0, 1);
+      state() = saved;
+      return;
+    }
+    std::lock_guard<std::mutex> serialize(run_mutex_); // one region at a time
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = [&f](int t, int nt) { f(t, nt); };
+      pending_ = size_ - 1; // idle threads also respond
+      ++generation_;
+    }
+    start_.notify_all();
+    execute(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+  }
+
+  static int thread_num() { return state().thread_num; }
+  static int num_threads() { return state().num_threads; }
+  static bool in_region() { return state().num_threads > 1; }
+
+private:
+  struct thread_state {
+    int thread_num = 0;
+    int num_threads = 1;
+  };
+  static thread_state& state() {
+    static thread_local thread_state s;
+    return s;
+  }
+  void execute(int t) {
+    if (t >= active_) return;
+    state().thread_num = t;
+    state().num_threads = active_;
+    job_(t, active_);
+    state() = thread_state();
+  }
+  void worker(int t, unsigned long generation) {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [&] { return stop_ || generation_ != generation; });
+        if (stop_) return;
+        generation = generation_;
+      }
+      execute(t);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) done_.notify_one();
+      }
+    }
+  }
+
+  int size_;   // number of threads including the calling one
+  int active_; // number of threads joining parallel regions
+  std::vector<std::thread> workers_;
+  std::function<void(int, int)> job_;
+  std::mutex run_mutex_, mutex_;
+  std::condition_variable start_, done_;
+  unsigned long generation_;
+  int pending_;
+  bool stop_;
+};
+
+inline int max_threads() { return thread_pool::instance().size(); }
+inline void set_num_threads(int n) { thread_pool::instance().resize(n); }
+inline int num_threads() { return thread_pool::num_threads(); }
+inline int thread_num() { return thread_pool::thread_num(); }
+
+template<class F>
+inline void run(F const& f) { thread_pool::instance().run(f); }
+
+#elif defined(_OPENMP)
+
+inline int max_threads() { return omp_get_max_threads(); }
+inline void set_num_threads(int n) { omp_set_num_threads(n); }
+inline int num_threads() { return omp_get_num_threads(); }
+inline int thread_num() { return omp_get_thread_num(); }
+
+template<class F>
+inline void run(F const& f) {
+  #pragma omp parallel
+  f(omp_get_thread_num(), omp_get_num_threads());
+}
+
+#else
+
+inline int max_threads() { return 1; }
+inline void set_num_threads(int) {}
+inline int num_threads() { return 1; }
+inline int thread_num() { return 0; }
+
+template<class F>
+inline void run(F const& f) { f(0, 1); }
+
+#endif
+
+// first index of block t when [first, last) is divided into nt blocks
+template<typename I>
+inline I block_begin(I first, I last, int t, int nt) {
+  return first + static_cast<I>(static_cast<long long>(last - first) * t / nt);
+}
+
+// call f(i) for i in [first, last); each thread takes a contiguous block (static schedule)
+template<typename I, class F>
+inline void for_each(I first, I last, F const& f) {
+  run([&](int t, int nt) {
+    I end = block_begin(first, last, t + 1, nt);
+    for (I i = block_begin(first, last, t, nt); i < end; ++i) f(i);
+  });
+}
+
+// call f(i) for i in [first, last); threads take chunks of given size in turn (dynamic schedule)
+template<typename I, class F>
+inline void for_each_dynamic(I first, I last, I chunk, F const& f) {
+#ifdef CLUSTER_THREAD_SAFE
+  std::atomic<I> next(first);
+  run([&](int, int) {
+    while (true) {
+      I begin = next.fetch_add(chunk, std::memory_order_relaxed);
+      if (begin >= last) break;
+      I end = (last - begin > chunk) ? begin + chunk : last;
+      for (I i = begin; i < end; ++i) f(i);
+    }
+  });
+#else
+  (void)chunk;
+  for (I i = first; i < last; ++i) f(i);
+#endif
+}
+
+} // end namespace parallel
+} // end namespace cluster
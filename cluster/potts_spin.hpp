@@ -0,0 +1,75 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Compact spins of q-state Potts model (q <= 256) and their modular addition without division
+//
+// Flipping a cluster in Swendsen-Wang algorithm adds a random shift in [0, q) to its spins modulo
+// q.  add_mod<Q> does it for q known at compile time (XOR for q = 2, mask for power of 2, and
+// conditional subtraction by mask otherwise), and add_mod<0> for q given at run time.
+// dispatch(q, f) calls f(add) with add_mod<Q> for common values of q, or add_mod<0> otherwise.
+//
+// Example:
+//   std::vector<cluster::potts::spin_type> spins(n, 0);
+//   cluster::potts::dispatch(q, [&](auto add) {
+//     for (int s = 0; s < n; ++s) spins[s] = add(spins[s], flip[cluster_id(s)]);
+//   });
+
+#pragma once
+
+#include <cstdint>
+
+namespace cluster {
+namespace potts {
+
+typedef std::uint8_t spin_type;
+static const int max_q = 256;
+
+// (a + b) mod Q for a, b in [0, Q)
+template<int Q>
+struct add_mod {
+  static_assert(Q >= 2 && Q <= max_q, "q should be in [2, 256]");
+  int q() const { return Q; }
+  spin_type operator()(spin_type a, spin_type b) const {
+    if (Q == 2) return a ^ b;
+    int c = a + b;
+    if ((Q & (Q - 1)) == 0) return c & (Q - 1);
+    return c - (Q & -(c >= Q));
+  }
+};
+
+// q given at run time
+template<>
+struct add_mod<0> {
+  explicit add_mod(int q) : q_(q) {}
+  int q() const { return q_; }
+  spin_type operator()(spin_type a, spin_type b) const {
+    int c = a + b;
+    return c - (q_ & -(c >= q_));
+  }
+private:
+  int q_;
+};
+
+template<class F>
+void dispatch(int q, F const& f) {
+  switch (q) {
+  case 2: f(add_mod<2>()); break;
+  case 3: f(add_mod<3>()); break;
+  case 4: f(add_mod<4>()); break;
+  case 5: f(add_mod<5>()); break;
+  case 8: f(add_mod<8>()); break;
+  case 10: f(add_mod<10>()); break;
+  default: f(add_mod<0>(q)); break;
+  }
+}
+
+} // end namespace potts
+} // end namespace cluster
@@ -0,0 +1,154 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Run-length collapsing of active bonds before union-find
+//
+// On a lattice whose sites are numbered contiguously along one axis, active bonds (s, s+1) form
+// runs of consecutive sites.  Since every node of a run is still a root of weight 1 right after
+// reset, a run can be linked into a star by link_run() without any find.  run_collector takes
+// active bonds in order of source and links runs as soon as they end.  The other bonds are
+// queued and unified once both of their ends have passed the run being collected (i.e. about one
+// row or plane later, while their nodes are still in cache), since unify on a node that may
+// still join a run would break the assumption of link_run.
+//
+// In the thread-safe version, each thread collects bonds whose sources are in its own range
+// [first, last) of nodes; runs are confined to the range, so that their nodes are written by a
+// single thread only.  Bonds reaching outside the range are returned to the caller, to be
+// unified after all the threads have finished collecting.
+//
+// Example:
+//   reset(fragments);
+//   std::vector<std::pair<int, int> > pairs;
+//   run_collector<policy_t, fragments_t> runs(fragments, pairs, 0, n);
+//   for (int b = 0; b < nb; ++b) if (active(b)) runs.add(source(b), target(b));
+//   runs.flush();
+//   unify_batch<policy_t>(fragments, pairs); // empty for range [0, n)
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "union_find.hpp"
+
+namespace cluster {
+namespace union_find {
+
+// rem_splicing and link_by_index keep parent index larger than child index, so that the last
+// node of a run should be its root; the others take the first one
+template<class POLICY>
+struct links_upward : std::false_type {};
+template<>
+struct links_upward<rem_splicing> : std::true_type {};
+template<>
+struct links_upward<link_by_index> : std::true_type {};
+
+// weight of root of a star of n nodes, by folding RULE::merge as unify would do; policies without
+// linking rule do not use weight of root
+template<class POLICY>
+struct run_weight {
+  template<typename I>
+  static bool get(I, I&) { return false; }
+};
+template<template<class> class P, class RULE>
+struct run_weight<P<RULE> > {
+  template<typename I>
+  static bool get(I n, I& w) {
+    w = 1;
+    for (I i = 1; i < n; ++i) w = RULE::merge(w, I(1));
+    return true;
+  }
+};
+
+// link nodes [first, first+n), which should all be roots of weight 1 (e.g. just after reset),
+// into one cluster whose nodes point directly to its root
+template<class POLICY = default_unify_policy, class V>
+void link_run(V& v, index_t<V> first, index_t<V> n) {
+  typedef index_t<V> I;
+  if (n < 2) return;
+  I r = links_upward<POLICY>::value ? first + n - 1 : first;
+  I w;
+  if (run_weight<POLICY>::get(n, w)) v[r].set_weight(w);
+  for (I i = first; i < first + n; ++i)
+    if (i != r) v[i].set_parent(r);
+  CLUSTER_STATISTICS(statistics::local().run_links += n - 1);
+}
+
+template<class POLICY, class V>
+class run_collector {
+public:
+  typedef index_t<V> index_type;
+  typedef std::vector<std::pair<index_type, index_type> > pairs_type;
+
+  // bonds with source in [first, last) are to be added.  Bonds with both ends in the range are
+  // unified by the collector; the others are stored in pairs (cleared first), and are to be
+  // unified after all the threads have finished collecting
+  run_collector(V& v, pairs_type& pairs, index_type first, index_type last) :
+    v_(v), pairs_(pairs), first_(first), last_(last), head_(-1), tail_(-1), front_(0) {
+    pairs_.clear();
+  }
+
+  // active bond between g0 and g1; bonds should be added in nondecreasing order of g0
+  void add(index_type g0, index_type g1) {
+    bool local = (g0 >= first_ && g0 < last_ && g1 >= first_ && g1 < last_);
+    if (local && g1 == g0 + 1) {
+      if (g0 != tail_) {
+        link();
+        head_ = g0;
+      }
+      tail_ = g1;
+    } else if (local) {
+      queue_.emplace_back(g0, g1);
+    } else {
+      pairs_.emplace_back(g0, g1);
+    }
+    unify_settled((tail_ >= 0) ? head_ : g0);
+  }
+
+  // link the last run and unify the remaining bonds in the range
+  void flush() {
+    link();
+    unify_settled(last_);
+  }
+
+private:
+  void link() {
+    if (tail_ >= 0) link_run<POLICY>(v_, head_, tail_ - head_ + 1);
+    head_ = tail_ = -1;
+  }
+
+  // unify queued bonds (in order) as long as both ends are below frontier, i.e. no longer
+  // to be linked as members of a run
+  void unify_settled(index_type frontier) {
+    for (; front_ < queue_.size(); ++front_) {
+      auto const& p = queue_[front_];
+      if (p.first >= frontier || p.second >= frontier) break;
+      unify<POLICY>(v_, p.first, p.second);
+    }
+    if (front_ == queue_.size()) {
+      queue_.clear();
+      front_ = 0;
+    } else if (front_ > 4096 && 2 * front_ > queue_.size()) {
+      queue_.erase(queue_.begin(), queue_.begin() + front_);
+      front_ = 0;
+    }
+  }
+
+  V& v_;
+  pairs_type& pairs_;
+  index_type first_, last_, head_, tail_;
+  pairs_type queue_;
+  std::size_t front_;
+};
+
+} // end namespace union_find
+} // end namespace cluster
@@ -0,0 +1,179 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Vectorized kernels for whole-forest passes of union-find (root counting, id assignment and id
+// copy) on raw 32-bit parent words.  Parent word p of node i is stored at parent[i * stride] and
+// its id at id[i * stride]; p > 0 means non-root with parent p - 1 (see basic_parent_word in
+// union_find.hpp).  AVX2 version is selected at run time if supported by CPU; otherwise (or if
+// CLUSTER_DISABLE_SIMD is defined) scalar version is used.  Offsets i * stride are int (32-bit
+// gather indices), so that the kernels may be used only for forests of up to INT_MAX / stride
+// nodes (fits()); larger ones should take the generic loops.
+
+#pragma once
+
+#if !defined(CLUSTER_DISABLE_SIMD) && defined(__GNUC__) && \
+  (defined(__x86_64__) || defined(__i386__))
+# define CLUSTER_HAVE_AVX2_KERNEL
+# include <immintrin.h>
+#endif
+
+#include <climits>
+#include <cstddef>
+
+namespace cluster {
+namespace simd {
+
+inline bool fits(std::size_t size, int stride) {
+  return size <= static_cast<std::size_t>(INT_MAX / stride);
+}
+
+// scalar version
+
+inline int count_root_scalar(int const* parent, int stride, int start, int n) {
+  int nc = 0;
+  for (int i = start; i < start + n; ++i) nc += (parent[i * stride] <= 0);
+  return nc;
+}
+
+inline int set_id_scalar(int const* parent, int* id, int stride, int start, int n, int nc) {
+  for (int i = start; i < start + n; ++i)
+    if (parent[i * stride] <= 0) id[i * stride] = nc++;
+  return nc;
+}
+
+inline int root_scalar(int const* parent, int stride, int g) {
+  while (parent[g * stride] > 0) g = parent[g * stride] - 1;
+  return g;
+}
+
+// id of roots should have been set
+inline void copy_id_scalar(int const* parent, int* id, int stride, int start, int n) {
+  for (int i = start; i < start + n; ++i)
+    if (parent[i * stride] > 0) id[i * stride] = id[root_scalar(parent, stride, i) * stride];
+}
+
+#ifdef CLUSTER_HAVE_AVX2_KERNEL
+
+// AVX2 version: 8 nodes per step
+
+#define CLUSTER_AVX2 __attribute__((target("avx2"), always_inline))
+
+// load parent words (or ids) of nodes i...i+7
+CLUSTER_AVX2 inline __m256i load8(int const* p, int stride, int i) {
+  if (stride == 1)
+    return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i));
+  __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                   _mm256_set1_epi32(stride));
+  return _mm256_i32gather_epi32(p + i * stride, idx, 4);
+}
+
+// bit j is set if node i+j is root
+CLUSTER_AVX2 inline unsigned int root_mask8(__m256i p) {
+  return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(1), p)));
+}
+
+// replace parent words of non-root lanes by that of their roots (pointer jumping)
+CLUSTER_AVX2 inline __m256i jump8(int const* parent, int stride, __m256i p) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i vs = _mm256_set1_epi32(stride);
+  __m256i active = _mm256_cmpgt_epi32(p, zero);
+  while (!_mm256_testz_si256(active, active)) {
+    __m256i idx = _mm256_mullo_epi32(_mm256_sub_epi32(p, one), vs);
+    __m256i q = _mm256_mask_i32gather_epi32(zero, parent, idx, active, 4);
+    active = _mm256_and_si256(active, _mm256_cmpgt_epi32(q, zero));
+    p = _mm256_blendv_epi8(p, q, active);
+  }
+  return p;
+}
+
+__attribute__((target("avx2")))
+inline int count_root_avx2(int const* parent, int stride, int start, int n) {
+  int nc = 0;
+  int i = start;
+  for (; i + 8 <= start + n; i += 8)
+    nc += __builtin_popcount(root_mask8(load8(parent, stride, i)));
+  return nc + count_root_scalar(parent, stride, i, start + n - i);
+}
+
+__attribute__((target("avx2")))
+inline int set_id_avx2(int const* parent, int* id, int stride, int start, int n, int nc) {
+  int i = start;
+  for (; i + 8 <= start + n; i += 8) {
+    for (unsigned int m = root_mask8(load8(parent, stride, i)); m != 0; m &= m - 1)
+      id[(i + __builtin_ctz(m)) * stride] = nc++;
+  }
+  return set_id_scalar(parent, id, stride, i, start + n - i, nc);
+}
+
+__attribute__((target("avx2")))
+inline void copy_id_avx2(int const* parent, int* id, int stride, int start, int n) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i vs = _mm256_set1_epi32(stride);
+  int i = start;
+  for (; i + 8 <= start + n; i += 8) {
+    __m256i p = load8(parent, stride, i);
+    __m256i nonroot = _mm256_cmpgt_epi32(p, zero);
+    if (_mm256_testz_si256(nonroot, nonroot)) continue;
+    p = jump8(parent, stride, p);
+    __m256i idx = _mm256_mullo_epi32(_mm256_sub_epi32(p, one), vs);
+    __m256i c = _mm256_mask_i32gather_epi32(zero, id, idx, nonroot, 4);
+    if (stride == 1) {
+      _mm256_maskstore_epi32(id + i, nonroot, c);
+    } else {
+      alignas(32) int buf[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(buf), c);
+      unsigned int m = _mm256_movemask_ps(_mm256_castsi256_ps(nonroot));
+      for (; m != 0; m &= m - 1) id[(i + __builtin_ctz(m)) * stride] = buf[__builtin_ctz(m)];
+    }
+  }
+  copy_id_scalar(parent, id, stride, i, start + n - i);
+}
+
+#undef CLUSTER_AVX2
+
+inline bool has_avx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+#else
+
+inline bool has_avx2() { return false; }
+
+#endif // CLUSTER_HAVE_AVX2_KERNEL
+
+// run-time dispatch
+
+inline int count_root(int const* parent, int stride, int start, int n) {
+#ifdef CLUSTER_HAVE_AVX2_KERNEL
+  if (has_avx2()) return count_root_avx2(parent, stride, start, n);
+#endif
+  return count_root_scalar(parent, stride, start, n);
+}
+
+inline int set_id(int const* parent, int* id, int stride, int start, int n, int nc) {
+#ifdef CLUSTER_HAVE_AVX2_KERNEL
+  if (has_avx2()) return set_id_avx2(parent, id, stride, start, n, nc);
+#endif
+  return set_id_scalar(parent, id, stride, start, n, nc);
+}
+
+inline void copy_id(int const* parent, int* id, int stride, int start, int n) {
+#ifdef CLUSTER_HAVE_AVX2_KERNEL
+  if (has_avx2()) return copy_id_avx2(parent, id, stride, start, n);
+#endif
+  copy_id_scalar(parent, id, stride, start, n);
+}
+
+} // end namespace simd
+} // end namespace cluster
@@ -0,0 +1,125 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Single-cluster (Wolff) growth
+//
+// single_cluster(n) grows one cluster from a seed site by breadth-first search, for a lattice of
+// n sites given by neighbors(s, f), which calls f(t) for each neighbor t of s.  bond(s, t, th) is
+// called at most once for each bond from a site s in the cluster to a site t not (yet) in it, and
+// t is added if it returns true; th is the thread number (0 in grow()).  members() lists the
+// sites of the last cluster in order of addition, which serves as the queue itself.  Sites are
+// marked by the number of the cluster (epoch) instead of a flag, so that nothing has to be
+// cleared between clusters; the marks are cleared only when the 32-bit epoch wraps around.
+//
+// grow_parallel() expands the frontier (sites added in the last round) in parallel, one block of
+// it per thread, as long as it has at least min_frontier sites, and sequentially otherwise.  A
+// site is claimed by compare-and-swap of its mark, so that which bond adds it depends on timing,
+// but the cluster is the same in distribution.  bond() should then use a random number stream of
+// thread th, and must not modify the configuration while the cluster grows.
+//
+// Example:
+//   cluster::single_cluster wolff(N);
+//   int s0 = N * uniform01(eng);
+//   int c = wolff.grow(s0, neighbors, [&](int, int t, int) {
+//     return spins[t] == spins[s0] && uniform01(eng) < 1 - std::exp(-2 / T);
+//   });
+//   for (int s : wolff.members()) spins[s] ^= 1;
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parallel.hpp"
+
+namespace cluster {
+
+class single_cluster {
+public:
+  explicit single_cluster(std::size_t n) : mark_(n), epoch_(0) {}
+
+  std::size_t num_sites() const { return mark_.size(); }
+
+  // sites of the last cluster in order of addition
+  std::vector<int> const& members() const { return members_; }
+  bool contains(int s) const { return mark_[s].load(std::memory_order_relaxed) == epoch_; }
+
+  // returns the size of the cluster
+  template<class NEIGHBORS, class BOND>
+  std::size_t grow(int seed, NEIGHBORS const& neighbors, BOND const& bond) {
+    start(seed);
+    for (std::size_t i = 0; i < members_.size(); ++i) expand(members_[i], neighbors, bond);
+    return members_.size();
+  }
+
+  template<class NEIGHBORS, class BOND>
+  std::size_t grow_parallel(int seed, NEIGHBORS const& neighbors, BOND const& bond,
+                            std::size_t min_frontier = 1024) {
+    start(seed);
+    std::size_t first = 0;
+    while (first < members_.size()) {
+      std::size_t last = members_.size();
+      if (last - first < min_frontier) {
+        for (std::size_t i = first; i < last; ++i) expand(members_[i], neighbors, bond);
+      } else {
+        next_.resize(parallel::max_threads());
+        parallel::run([&](int th, int nt) {
+          std::vector<int>& next = next_[th];
+          next.clear();
+          for (std::size_t i = parallel::block_begin(first, last, th, nt);
+               i < parallel::block_begin(first, last, th + 1, nt); ++i) {
+            int s = members_[i];
+            neighbors(s, [&](int t) {
+              std::uint32_t m = mark_[t].load(std::memory_order_relaxed);
+              if (m != epoch_ && bond(s, t, th) &&
+                  mark_[t].compare_exchange_strong(m, epoch_, std::memory_order_relaxed))
+                next.push_back(t);
+            });
+          }
+        });
+        for (auto const& next : next_) members_.insert(members_.end(), next.begin(), next.end());
+      }
+      first = last;
+    }
+    return members_.size();
+  }
+
+private:
+  void start(int seed) {
+    if (++epoch_ == 0) {
+      // epoch wrapped around
+      for (auto& m : mark_) m.store(0, std::memory_order_relaxed);
+      epoch_ = 1;
+    }
+    members_.clear();
+    mark_[seed].store(epoch_, std::memory_order_relaxed);
+    members_.push_back(seed);
+  }
+
+  template<class NEIGHBORS, class BOND>
+  void expand(int s, NEIGHBORS const& neighbors, BOND const& bond) {
+    neighbors(s, [&](int t) {
+      if (!contains(t) && bond(s, t, 0)) {
+        mark_[t].store(epoch_, std::memory_order_relaxed);
+        members_.push_back(t);
+      }
+    });
+  }
+
+  std::vector<std::atomic<std::uint32_t> > mark_; // epoch of the last cluster containing site
+  std::uint32_t epoch_;
+  std::vector<int> members_;
+  std::vector<std::vector<int> > next_; // frontier found by each thread
+};
+
+} // end namespace cluster
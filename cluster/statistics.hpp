@@ -0,0 +1,179 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Opt-in instrumentation of union-find hot paths, enabled by defining CLUSTER_ENABLE_STATISTICS.
+// Each thread updates its own counters and histograms (no atomic operation on the hot path),
+// which are summed up by print().  If not enabled, CLUSTER_STATISTICS(...) expands to nothing
+// and print() writes nothing.
+//
+// Counters:
+//   find depth          number of parent steps from node to root in root_index/root_index_ph
+//   unify calls/merges  calls of unify() and those that actually merged two clusters
+//   run-length links    bonds linked by link_run() without unify (see run_length.hpp)
+//   lock_root failures  lock_root() that found root locked by another thread or lost CAS
+//   unify/set_root retries  retry loops after failed lock or link in the thread-safe version
+//   pack_tree walks     parent steps of pack_tree until a packed node or root is found
+//   tree depth          depth of every node before copy_id (extra pass)
+
+#pragma once
+
+#include <iostream>
+
+#ifdef CLUSTER_ENABLE_STATISTICS
+# include <algorithm>
+# include <cstdint>
+# include <mutex>
+# include <vector>
+# define CLUSTER_STATISTICS(...) __VA_ARGS__
+#else
+# define CLUSTER_STATISTICS(...)
+#endif
+
+namespace cluster {
+namespace statistics {
+
+#ifdef CLUSTER_ENABLE_STATISTICS
+
+// histogram with logarithmic bins [0], [1], [2,3], [4,7], ...
+class histogram {
+public:
+  static const int bins = 65; // bit length of 64-bit values
+  histogram() : count_(bins, 0), sum_(0), max_(0) {}
+  void add(std::uint64_t x) {
+    int b = 0;
+    for (std::uint64_t y = x; y != 0; y >>= 1) ++b;
+    ++count_[b];
+    sum_ += x;
+    max_ = std::max(max_, x);
+  }
+  void merge(histogram const& h) {
+    for (int b = 0; b < bins; ++b) count_[b] += h.count_[b];
+    sum_ += h.sum_;
+    max_ = std::max(max_, h.max_);
+  }
+  std::uint64_t total() const {
+    std::uint64_t n = 0;
+    for (int b = 0; b < bins; ++b) n += count_[b];
+    return n;
+  }
+  void print(std::ostream& os) const {
+    std::uint64_t n = total();
+    os << "count = " << n << ", mean = " << (n ? double(sum_) / n : 0.) << ", max = " << max_
+       << ", histogram =";
+    for (int b = 0; b < bins; ++b) {
+      if (count_[b] == 0) continue;
+      std::uint64_t lo = (b == 0) ? 0 : (std::uint64_t(1) << (b - 1));
+      std::uint64_t hi = (b == 0) ? 0 : (2 * lo - 1);
+      os << " [" << lo;
+      if (hi > lo) os << '-' << hi;
+      os << "]:" << count_[b];
+    }
+  }
+private:
+  std::vector<std::uint64_t> count_;
+  std::uint64_t sum_, max_;
+};
+
+struct counters {
+  histogram find_depth;
+  histogram pack_walk;
+  histogram tree_depth;
+  std::uint64_t unify_calls = 0;
+  std::uint64_t unify_merges = 0;
+  std::uint64_t run_links = 0;
+  std::uint64_t lock_failures = 0;
+  std::uint64_t unify_retries = 0;
+  std::uint64_t set_root_retries = 0;
+  void merge(counters const& c) {
+    find_depth.merge(c.find_depth);
+    pack_walk.merge(c.pack_walk);
+    tree_depth.merge(c.tree_depth);
+    unify_calls += c.unify_calls;
+    unify_merges += c.unify_merges;
+    run_links += c.run_links;
+    lock_failures += c.lock_failures;
+    unify_retries += c.unify_retries;
+    set_root_retries += c.set_root_retries;
+  }
+};
+
+// counters of all the threads; those of finished threads are merged into retired
+class registry {
+public:
+  // never destroyed, since threads of a static pool may finish after static destructors
+  static registry& instance() {
+    static registry* r = new registry;
+    return *r;
+  }
+  void add(counters* c) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.push_back(c);
+  }
+  void remove(counters* c) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.merge(*c);
+    threads_.erase(std::remove(threads_.begin(), threads_.end(), c), threads_.end());
+  }
+  // should be called outside parallel regions
+  counters sum(int& nthreads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters total = retired_;
+    for (auto c : threads_) total.merge(*c);
+    nthreads = threads_.size();
+    return total;
+  }
+private:
+  std::mutex mutex_;
+  std::vector<counters*> threads_;
+  counters retired_;
+};
+
+class thread_counters {
+public:
+  thread_counters() { registry::instance().add(&c_); }
+  ~thread_counters() { registry::instance().remove(&c_); }
+  counters& get() { return c_; }
+private:
+  counters c_;
+};
+
+inline counters& local() {
+  static thread_local thread_counters c;
+  return c.get();
+}
+
+inline void print(std::ostream& os) {
+  int nthreads;
+  counters c = registry::instance().sum(nthreads);
+  os << "Union-find statistics (" << nthreads << " threads):\n"
+     << "  unify: calls = " << c.unify_calls << ", merges = " << c.unify_merges
+     << ", no-ops = " << (c.unify_calls - c.unify_merges) << std::endl
+     << "  run-length: bonds linked without unify = " << c.run_links << std::endl
+     << "  contention: lock_root failures = " << c.lock_failures
+     << ", unify retries = " << c.unify_retries
+     << ", set_root retries = " << c.set_root_retries << std::endl
+     << "  find depth: ";
+  c.find_depth.print(os);
+  os << "\n  pack_tree walk: ";
+  c.pack_walk.print(os);
+  os << "\n  tree depth before copy_id: ";
+  c.tree_depth.print(os);
+  os << std::endl;
+}
+
+#else
+
+inline void print(std::ostream&) {}
+
+#endif // CLUSTER_ENABLE_STATISTICS
+
+} // end namespace statistics
+} // end namespace cluster
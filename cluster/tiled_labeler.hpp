@@ -0,0 +1,207 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Two-level cluster labeling of lattice models
+//
+// Sites are divided into tiles of contiguous indices (tile size should be chosen so that nodes
+// of a tile fit in cache).  Inside each tile, nodes are ordered so that the sites with bonds to
+// other tiles (boundary sites) come first.
+//   1. each tile is labeled by a single thread with unify on its own nodes only (no lock), and
+//      pack_tree moves the roots of clusters touching the tile boundary to the boundary sites
+//   2. forests of the boundary sites of all the tiles are copied to the boundary forest, and
+//      merged by unify on the bonds between tiles (in parallel)
+//   3. cluster id is given to the boundary clusters first and then to clusters inside each tile,
+//      and is copied to all the nodes of each tile
+// Only the boundary forest is shared among threads, so that a cluster spanning the lattice (e.g.
+// near the critical point) does not serialize all the threads on the lock of its root.
+//
+// Example:
+//   cluster::union_find::tiled_labeler<> labeler(lattice, 1 << 14);
+//   int nc = labeler.label([&](int b) { return active[b]; });
+//   for (int s = 0; s < lattice.num_sites(); ++s) ... labeler.cluster_id(s) ...
+//   for (int c = 0; c < nc; ++c) ... labeler.cluster_weight(c) ...
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "union_find.hpp"
+
+namespace cluster {
+namespace union_find {
+
+template<class T = node, class A = std::allocator<T> >
+class tiled_labeler {
+public:
+  typedef T value_type;
+  typedef typename T::index_type index_type;
+  // unify inside a tile and between tiles; both maintain weight of clusters
+  typedef pathhalving_local<default_rule> tile_policy;
+  typedef pathhalving<default_rule> boundary_policy;
+
+  // lattice should provide num_sites(), num_bonds(), source(b) and target(b)
+  template<class G>
+  tiled_labeler(G const& lattice, std::size_t tile_size) { init(lattice, tile_size); }
+
+  std::size_t num_sites() const { return pos_.size(); }
+  std::size_t num_tiles() const { return num_tiles_; }
+  std::size_t tile_size() const { return tile_size_; }
+  std::size_t num_boundary_sites() const { return boundary_.size(); }
+
+  // label clusters connected by bonds b with active(b) == true; returns number of clusters.
+  // active is called concurrently and should not have side effects.
+  template<class F>
+  index_type label(F const& active) {
+    I nt = num_tiles_;
+
+    // 1. label each tile
+    parallel::for_each_dynamic(I(0), nt, I(1), [&](I t) {
+      span<T> v = tile(t);
+      std::fill(v.begin(), v.end(), T());
+      for (I k = bond_begin_[t]; k < bond_begin_[t + 1]; ++k)
+        if (active(bonds_[k].bond)) unify<tile_policy>(v, bonds_[k].n0, bonds_[k].n1);
+      I nb = num_boundary(t);
+      pack_tree(v, nb);
+      for (I i = 0; i < nb; ++i) {
+        if (v[i].is_root())
+          boundary_[boundary_begin_[t] + i].set_weight(v[i].weight());
+        else
+          boundary_[boundary_begin_[t] + i].set_parent(boundary_begin_[t] + v[i].parent());
+      }
+      offset_[t + 1] = count_root(v, nb, I(v.size()) - nb);
+    });
+
+    // 2. merge boundary forest
+    parallel::for_each_dynamic(std::size_t(0), cross_.size(), std::size_t(64),
+                               [&](std::size_t k) {
+      if (active(cross_[k].bond)) unify<boundary_policy>(boundary_, cross_[k].n0, cross_[k].n1);
+    });
+    offset_[0] = assign_id(boundary_);
+    for (I t = 0; t < nt; ++t) offset_[t + 1] += offset_[t];
+    num_clusters_ = offset_[nt];
+    if (weight_.size() < std::size_t(num_clusters_)) weight_.resize(num_clusters_);
+    parallel::for_each(I(0), I(boundary_.size()), [&](I i) {
+      if (boundary_[i].is_root()) weight_[boundary_[i].id()] = boundary_[i].weight();
+    });
+
+    // 3. assign cluster id to each tile
+    parallel::for_each_dynamic(I(0), nt, I(1), [&](I t) {
+      span<T> v = tile(t);
+      I nb = num_boundary(t);
+      for (I i = 0; i < nb; ++i)
+        if (v[i].is_root()) v[i].set_id(boundary_[boundary_begin_[t] + i].id());
+      I c = offset_[t];
+      for (I i = nb; i < I(v.size()); ++i) {
+        if (v[i].is_root()) {
+          v[i].set_id(c);
+          weight_[c++] = v[i].weight();
+        }
+      }
+      copy_id(v, 0, v.size());
+    });
+    return num_clusters_;
+  }
+
+  // results of the last label()
+  index_type num_clusters() const { return num_clusters_; }
+  index_type cluster_id(index_type s) const { return fragments_[pos_[s]].id(); }
+  index_type cluster_weight(index_type c) const { return weight_[c]; }
+
+private:
+  typedef index_type I;
+  struct bond_t {
+    I bond;
+    I n0, n1; // node index in tile, or in boundary forest
+  };
+
+  template<class G>
+  void init(G const& lattice, std::size_t tile_size) {
+    I n = lattice.num_sites();
+    tile_size_ = std::max(tile_size, std::size_t(1));
+    num_tiles_ = (n + tile_size_ - 1) / tile_size_;
+    I nt = num_tiles_;
+    auto tile_of = [&](I s) { return I(s / tile_size_); };
+
+    // boundary sites come first in each tile
+    std::vector<char> is_boundary(n, 0);
+    for (I b = 0; b < I(lattice.num_bonds()); ++b) {
+      I s0 = lattice.source(b);
+      I s1 = lattice.target(b);
+      if (tile_of(s0) != tile_of(s1)) is_boundary[s0] = is_boundary[s1] = 1;
+    }
+    pos_.resize(n);
+    boundary_begin_.assign(nt + 1, 0);
+    for (I t = 0; t < nt; ++t) {
+      I first = t * tile_size_;
+      I last = std::min(first + I(tile_size_), n);
+      I p = first;
+      for (I s = first; s < last; ++s) if (is_boundary[s]) pos_[s] = p++;
+      boundary_begin_[t + 1] = boundary_begin_[t] + (p - first);
+      for (I s = first; s < last; ++s) if (!is_boundary[s]) pos_[s] = p++;
+    }
+
+    // bonds inside each tile (in local index) and between tiles (in index of boundary forest)
+    std::vector<I> count(nt + 1, 0);
+    for (I b = 0; b < I(lattice.num_bonds()); ++b) {
+      I t = tile_of(lattice.source(b));
+      if (t == tile_of(lattice.target(b))) ++count[t + 1];
+    }
+    bond_begin_.assign(nt + 1, 0);
+    for (I t = 0; t < nt; ++t) bond_begin_[t + 1] = bond_begin_[t] + count[t + 1];
+    bonds_.resize(bond_begin_[nt]);
+    cross_.clear();
+    std::fill(count.begin(), count.end(), 0);
+    for (I b = 0; b < I(lattice.num_bonds()); ++b) {
+      I s0 = lattice.source(b);
+      I s1 = lattice.target(b);
+      I t0 = tile_of(s0);
+      I t1 = tile_of(s1);
+      if (t0 == t1) {
+        bond_t bond = { b, local_index(s0), local_index(s1) };
+        bonds_[bond_begin_[t0] + count[t0]++] = bond;
+      } else {
+        bond_t bond = { b, boundary_begin_[t0] + local_index(s0),
+                        boundary_begin_[t1] + local_index(s1) };
+        cross_.push_back(bond);
+      }
+    }
+
+    fragments_.resize(n);
+    boundary_.resize(boundary_begin_[nt]);
+    offset_.resize(nt + 1);
+    num_clusters_ = 0;
+  }
+
+  span<T> tile(I t) {
+    I first = t * tile_size_;
+    return span<T>(fragments_.data() + first,
+                   std::min(first + I(tile_size_), I(pos_.size())) - first);
+  }
+  I num_boundary(I t) const { return boundary_begin_[t + 1] - boundary_begin_[t]; }
+  I local_index(I s) const { return pos_[s] - I(s / tile_size_ * tile_size_); }
+
+  std::size_t tile_size_, num_tiles_;
+  std::vector<I> pos_;            // position of site in fragments_
+  std::vector<I> boundary_begin_; // first index of boundary sites of each tile in boundary_
+  std::vector<I> bond_begin_;     // first bond inside each tile in bonds_
+  std::vector<bond_t> bonds_;     // bonds inside tiles
+  std::vector<bond_t> cross_;     // bonds between tiles
+  std::vector<T, A> fragments_;   // nodes of all the tiles
+  std::vector<T> boundary_;       // boundary forest
+  std::vector<I> offset_;         // number of clusters before (interior of) each tile
+  std::vector<I> weight_;         // weight of each cluster
+  I num_clusters_;
+};
+
+} // end namespace union_find
+} // end namespace cluster
@@ -18,45 +18,79 @@
 #pragma once
 
 #include <algorithm> // for std::swap
+#include <cstdint>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
-
-#ifdef _OPENMP
-# include <omp.h>
-# include <atomic>
-#endif
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "statistics.hpp"
 
 namespace cluster {
 namespace union_find {
 
-class node {
+// parent word shared by node, node_noweight and forest: parent index + 1 for non-root node,
+// negative weight for root node, and zero for locked root.  Index type I should be a signed
+// integer type, which limits the number of nodes to std::numeric_limits<I>::max().
+//
+// In the thread-safe version, the parent word is the only shared state touched while clusters
+// are being built, and every decision (is root, lock, link) is taken from a single load or
+// compare-and-swap of it.  Acquire loads and release stores are therefore enough for the
+// lock_root/unlock protocol, and path compression uses relaxed stores, since any value written
+// there is an ancestor of the node.  Other data (id, cluster properties) must be published by a
+// barrier between the phases, as is done at the end of each parallel region (see parallel.hpp).
+template<typename I>
+class basic_parent_word {
 public:
-  node() : parent_(-1) {} // root node with weight = 1
-#ifdef _OPENMP
-  node(const node& rhs) : id_(rhs.id_) { parent_.store(rhs.parent_.load()); }
-  node& operator=(const node& rhs) {
-    parent_.store(rhs.parent_.load());
-    id_ = rhs.id_;
+  static_assert(std::numeric_limits<I>::is_integer && std::numeric_limits<I>::is_signed,
+                "index type should be a signed integer type");
+  typedef I index_type;
+  basic_parent_word() : parent_(-1) {} // root node with weight = 1
+#ifdef CLUSTER_THREAD_SAFE
+  basic_parent_word(const basic_parent_word& rhs) :
+    parent_(rhs.parent_.load(std::memory_order_relaxed)) {}
+  basic_parent_word& operator=(const basic_parent_word& rhs) {
+    parent_.store(rhs.parent_.load(std::memory_order_relaxed), std::memory_order_relaxed);
     return *this;
   }
-#else
-  // default copy constructor and assignment operator is fine
-#endif
-  bool is_root() const { return parent_ <= 0; }
-  void set_parent(int parent) { parent_ = parent + 1; }
-  int parent() const { return parent_ - 1; }
-  void set_weight(int w) { parent_ = -w; }
-  int weight() const { return -parent_; }
-  void set_id(int id) { id_ = id; }
-  int id() const { return id_; }
-#ifdef _OPENMP
-  int lock_root() {
-    int p = parent_;
-    return (p < 0 && parent_.compare_exchange_weak(p, 0)) ? (-p) : 0;
+  bool is_root() const { return parent_.load(std::memory_order_acquire) <= 0; }
+  void set_parent(I parent) { parent_.store(parent + 1, std::memory_order_release); }
+  I parent() const { return parent_.load(std::memory_order_acquire) - 1; }
+  void set_weight(I w) { parent_.store(-w, std::memory_order_release); }
+  I weight() const { return -parent_.load(std::memory_order_acquire); }
+  // parent index of non-root node, or -1 for root (single load of parent word)
+  I next() const {
+    I p = parent_.load(std::memory_order_acquire);
+    return (p > 0) ? (p - 1) : -1;
+  }
+  // redirect non-root node to one of its ancestors (path compression)
+  void set_ancestor(I g) { parent_.store(g + 1, std::memory_order_relaxed); }
+  // link (unlocked) root to parent; returns false if the node is not root any more
+  bool try_link(I parent) {
+    I p = parent_.load(std::memory_order_relaxed);
+    return p < 0 && parent_.compare_exchange_strong(p, parent + 1, std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed);
+  }
+  // replace parent of non-root node; returns false if it has been changed meanwhile
+  bool replace_parent(I from, I to) {
+    I p = from + 1;
+    return parent_.compare_exchange_strong(p, to + 1, std::memory_order_acq_rel,
+                                           std::memory_order_relaxed);
+  }
+  // add weight to root node
+  void add_weight(I w) { parent_.fetch_sub(w, std::memory_order_relaxed); }
+  I lock_root() {
+    I p = parent_.load(std::memory_order_relaxed);
+    bool locked = p < 0 && parent_.compare_exchange_weak(p, 0, std::memory_order_acquire,
+                                                         std::memory_order_relaxed);
+    CLUSTER_STATISTICS(if (!locked) ++statistics::local().lock_failures);
+    return locked ? (-p) : 0;
     //// example of THREAD-UNSAFE implementation
     //   if (parent_ < 0) {
-    //     int p = parent_;
+    //     I p = parent_;
     //     parent_ = 0;
     //     return -p;
     //   } else {
@@ -64,119 +98,620 @@ public:
     //   }
   }
   // unlock can be done by set_parent or set_weight
+#else
+  // default copy constructor and assignment operator is fine
+  bool is_root() const { return parent_ <= 0; }
+  void set_parent(I parent) { parent_ = parent + 1; }
+  I parent() const { return parent_ - 1; }
+  void set_weight(I w) { parent_ = -w; }
+  I weight() const { return -parent_; }
+  I next() const { return (parent_ > 0) ? (parent_ - 1) : -1; }
+  void set_ancestor(I g) { parent_ = g + 1; }
+  bool try_link(I parent) {
+    if (parent_ >= 0) return false;
+    parent_ = parent + 1;
+    return true;
+  }
+  bool replace_parent(I from, I to) {
+    if (parent_ != from + 1) return false;
+    parent_ = to + 1;
+    return true;
+  }
+  void add_weight(I w) { parent_ -= w; }
 #endif
 private:
-#ifdef _OPENMP
-  std::atomic<int> parent_; // negative for root fragment, zero for locked root
+#ifdef CLUSTER_THREAD_SAFE
+  std::atomic<I> parent_; // negative for root fragment, zero for locked root
 #else
-  int parent_;
+  I parent_;
 #endif
-  int id_;
 };
 
-class node_noweight {
+template<typename I>
+class basic_node {
 public:
-  node_noweight() : parent_(id_mask) {} // root note with id = 0
-#ifdef _OPENMP
-  node_noweight(const node_noweight& rhs) { parent_.store(rhs.parent_.load()); }
-  node_noweight& operator=(const node_noweight& rhs) {
-    parent_.store(rhs.parent_.load());
+  typedef I index_type;
+  // default constructor gives root node with weight = 1
+  bool is_root() const { return parent_.is_root(); }
+  void set_parent(I parent) { parent_.set_parent(parent); }
+  I parent() const { return parent_.parent(); }
+  void set_weight(I w) { parent_.set_weight(w); }
+  I weight() const { return parent_.weight(); }
+  void set_id(I id) { id_ = id; }
+  I id() const { return id_; }
+  I next() const { return parent_.next(); }
+  void set_ancestor(I g) { parent_.set_ancestor(g); }
+  bool try_link(I parent) { return parent_.try_link(parent); }
+  bool replace_parent(I from, I to) { return parent_.replace_parent(from, to); }
+  void add_weight(I w) { parent_.add_weight(w); }
+#ifdef CLUSTER_THREAD_SAFE
+  I lock_root() { return parent_.lock_root(); }
+  // unlock can be done by set_parent or set_weight
+#endif
+private:
+  basic_parent_word<I> parent_;
+  I id_;
+};
+
+// node without weight: cluster id is stored in the parent word of root node as weight id + 1
+template<typename I>
+class basic_node_noweight {
+public:
+  typedef I index_type;
+  // default constructor gives root note with id = 0
+  int is_root() const { return parent_.is_root(); }
+  void set_parent(I parent) { parent_.set_parent(parent); }
+  I parent() const { return parent_.parent(); }
+  void set_weight(I) { set_id(0); } // dummy routine for unlock
+  I weight() const { return 0; } // dummy
+  void set_id(I id) { parent_.set_weight(id + 1); }
+  I id() const { return parent_.weight() - 1; }
+  I next() const { return parent_.next(); }
+  void set_ancestor(I g) { parent_.set_ancestor(g); }
+  bool try_link(I parent) { return parent_.try_link(parent); }
+  bool replace_parent(I from, I to) { return parent_.replace_parent(from, to); }
+#ifdef CLUSTER_THREAD_SAFE
+  I lock_root() { return parent_.lock_root(); }
+  // unlock can be done by set_parent, set_weight or set_id
+#endif
+private:
+  basic_parent_word<I> parent_;
+};
+
+// structure-of-arrays counterpart of std::vector<basic_node<I> >: parent words and cluster ids
+// are kept in separate arrays, so that unify touches only the former.  Element access returns a
+// proxy with the same interface as basic_node<I>.  Both arrays are allocated by (rebound) A.
+template<typename I, class A = std::allocator<I> >
+class basic_forest {
+public:
+  typedef basic_node<I> value_type;
+  typedef basic_parent_word<I> parent_type;
+  typedef A allocator_type;
+
+  class const_reference {
+  public:
+    const_reference(parent_type const& p, I const& id) : parent_(p), id_(id) {}
+    bool is_root() const { return parent_.is_root(); }
+    I parent() const { return parent_.parent(); }
+    I weight() const { return parent_.weight(); }
+    I id() const { return id_; }
+    I next() const { return parent_.next(); }
+    operator value_type() const {
+      value_type n;
+      if (is_root()) n.set_weight(weight()); else n.set_parent(parent());
+      n.set_id(id_);
+      return n;
+    }
+  private:
+    parent_type const& parent_;
+    I const& id_;
+  };
+
+  class reference {
+  public:
+    reference(parent_type& p, I& id) : parent_(p), id_(id) {}
+    reference& operator=(reference const& rhs) {
+      parent_ = rhs.parent_;
+      id_ = rhs.id_;
+      return *this;
+    }
+    reference& operator=(value_type const& n) {
+      if (n.is_root()) set_weight(n.weight()); else set_parent(n.parent());
+      id_ = n.id();
+      return *this;
+    }
+    bool is_root() const { return parent_.is_root(); }
+    void set_parent(I parent) { parent_.set_parent(parent); }
+    I parent() const { return parent_.parent(); }
+    void set_weight(I w) { parent_.set_weight(w); }
+    I weight() const { return parent_.weight(); }
+    void set_id(I id) { id_ = id; }
+    I id() const { return id_; }
+    I next() const { return parent_.next(); }
+    void set_ancestor(I g) { parent_.set_ancestor(g); }
+    bool try_link(I parent) { return parent_.try_link(parent); }
+    bool replace_parent(I from, I to) { return parent_.replace_parent(from, to); }
+    void add_weight(I w) { parent_.add_weight(w); }
+#ifdef CLUSTER_THREAD_SAFE
+    I lock_root() { return parent_.lock_root(); }
+#endif
+    operator value_type() const { return const_reference(parent_, id_); }
+  private:
+    parent_type& parent_;
+    I& id_;
+  };
+
+  explicit basic_forest(std::size_t n = 0) : parent_(n), id_(n) {}
+  std::size_t size() const { return parent_.size(); }
+  void resize(std::size_t n) {
+    parent_.resize(n);
+    id_.resize(n);
+  }
+  void clear() {
+    parent_.clear();
+    id_.clear();
+  }
+  // reset all the nodes to root with weight = 1
+  void reset() { std::fill(parent_.begin(), parent_.end(), parent_type()); }
+  void push_back(value_type const& n) {
+    parent_.push_back(parent_type());
+    id_.push_back(0);
+    (*this)[size() - 1] = n;
+  }
+  // address of parent word (e.g. for prefetching)
+  void const* address(std::size_t i) const { return &parent_[i]; }
+  // contiguous arrays of parent words and ids (e.g. for vectorized kernels)
+  parent_type* parent_data() { return parent_.data(); }
+  I* id_data() { return id_.data(); }
+  reference operator[](std::size_t i) { return reference(parent_[i], id_[i]); }
+  const_reference operator[](std::size_t i) const { return const_reference(parent_[i], id_[i]); }
+private:
+  std::vector<parent_type,
+              typename std::allocator_traits<A>::template rebind_alloc<parent_type> > parent_;
+  std::vector<I, A> id_;
+};
+
+// parent word with epoch stamp: the upper 8 bits of the word hold the epoch of its last update
+// and the lower bits the value of basic_parent_word (sign-extended).  Word with epoch different
+// from the current one e (given to every member function) is stale, and reads as root with
+// weight = 1.  The word is unsigned integer W, by default of the same size as I, which limits
+// the number of nodes to max_nodes (2^23 - 1 for 32-bit I and W; std::numeric_limits<I>::max()
+// for 32-bit I and 64-bit W).  As in basic_parent_word, each decision is taken from a single load
+// or compare-and-swap of the word in the thread-safe version.
+template<typename I, typename W = typename std::make_unsigned<I>::type>
+class basic_epoch_parent_word {
+public:
+  static_assert(std::numeric_limits<I>::is_integer && std::numeric_limits<I>::is_signed &&
+                sizeof(I) >= sizeof(std::int32_t),
+                "index type should be a signed integer type of at least 32 bits");
+  static_assert(std::numeric_limits<W>::is_integer && !std::numeric_limits<W>::is_signed &&
+                sizeof(W) >= sizeof(I),
+                "word type should be an unsigned integer type at least as wide as index type");
+  typedef I index_type;
+  typedef W word_type;
+  typedef unsigned int epoch_type;
+  static const int epoch_bits = 8;
+  static const int value_bits = std::numeric_limits<word_type>::digits - epoch_bits;
+  static const epoch_type max_epoch = (1u << epoch_bits) - 1; // epoch 0 is always stale
+  static const int max_bits = (value_bits - 1 < std::numeric_limits<I>::digits) ?
+    (value_bits - 1) : std::numeric_limits<I>::digits;
+  static const I max_nodes = I((word_type(1) << max_bits) - 1);
+  basic_epoch_parent_word() : word_(0) {}
+#ifdef CLUSTER_THREAD_SAFE
+  basic_epoch_parent_word(const basic_epoch_parent_word& rhs) :
+    word_(rhs.word_.load(std::memory_order_relaxed)) {}
+  basic_epoch_parent_word& operator=(const basic_epoch_parent_word& rhs) {
+    word_.store(rhs.word_.load(std::memory_order_relaxed), std::memory_order_relaxed);
     return *this;
   }
+  I value(epoch_type e) const { return unpack(word_.load(std::memory_order_acquire), e); }
+  void set_value(epoch_type e, I p) { word_.store(pack(e, p), std::memory_order_release); }
+  void set_ancestor(epoch_type e, I g) { word_.store(pack(e, g + 1), std::memory_order_relaxed); }
+  bool try_link(epoch_type e, I parent) {
+    word_type w = word_.load(std::memory_order_relaxed);
+    return unpack(w, e) < 0 &&
+      word_.compare_exchange_strong(w, pack(e, parent + 1), std::memory_order_acq_rel,
+                                    std::memory_order_relaxed);
+  }
+  bool replace_parent(epoch_type e, I from, I to) {
+    word_type w = pack(e, from + 1);
+    return word_.compare_exchange_strong(w, pack(e, to + 1), std::memory_order_acq_rel,
+                                         std::memory_order_relaxed);
+  }
+  void add_weight(epoch_type e, I w) {
+    word_type v = word_.load(std::memory_order_relaxed);
+    while (!word_.compare_exchange_weak(v, pack(e, unpack(v, e) - w), std::memory_order_relaxed,
+                                        std::memory_order_relaxed)) {}
+  }
+  I lock_root(epoch_type e) {
+    word_type w = word_.load(std::memory_order_relaxed);
+    I p = unpack(w, e);
+    bool locked = p < 0 && word_.compare_exchange_weak(w, pack(e, 0), std::memory_order_acquire,
+                                                       std::memory_order_relaxed);
+    CLUSTER_STATISTICS(if (!locked) ++statistics::local().lock_failures);
+    return locked ? (-p) : 0;
+  }
 #else
-  // default copy constructor and assignment operator is fine
-#endif
-  int is_root() const { return (int) parent_ <= 0; }
-  void set_parent(int parent) { parent_ = parent + 1; }
-  int parent() const { return parent_ - 1; }
-  void set_weight(int) { set_id(0); } // dummy routine for unlock
-  int weight() const { return 0; } // dummy
-  void set_id(int id) { parent_ = id ^ id_mask; }
-  int id() const { return parent_ ^ id_mask; }
-#ifdef _OPENMP
-  int lock_root() {
-    int p = parent_;
-    return (p < 0 && parent_.compare_exchange_weak(p, 0)) ? (-p) : 0;
+  I value(epoch_type e) const { return unpack(word_, e); }
+  void set_value(epoch_type e, I p) { word_ = pack(e, p); }
+  void set_ancestor(epoch_type e, I g) { word_ = pack(e, g + 1); }
+  bool try_link(epoch_type e, I parent) {
+    if (value(e) >= 0) return false;
+    word_ = pack(e, parent + 1);
+    return true;
   }
-  // unlock can be done by set_parent, set_weight or set_id
+  bool replace_parent(epoch_type e, I from, I to) {
+    if (word_ != pack(e, from + 1)) return false;
+    word_ = pack(e, to + 1);
+    return true;
+  }
+  void add_weight(epoch_type e, I w) { word_ = pack(e, value(e) - w); }
 #endif
+  bool is_root(epoch_type e) const { return value(e) <= 0; }
+  void set_parent(epoch_type e, I parent) { set_value(e, parent + 1); }
+  I parent(epoch_type e) const { return value(e) - 1; }
+  void set_weight(epoch_type e, I w) { set_value(e, -w); }
+  I weight(epoch_type e) const { return -value(e); }
+  I next(epoch_type e) const {
+    I p = value(e);
+    return (p > 0) ? (p - 1) : -1;
+  }
 private:
-  static const int id_mask = -1;
-#ifdef _OPENMP
-  std::atomic<int> parent_; // negative for root fragment, zero for locked root
+  static word_type pack(epoch_type e, I p) {
+    return (word_type(e) << value_bits) | (word_type(p) & (~word_type(0) >> epoch_bits));
+  }
+  // sign extension of lower value_bits bits, or -1 if stale; without branch, since the latter is
+  // unpredictable in the first sweep after reset and would stall loads in flight (unify_batch)
+  static I unpack(word_type w, epoch_type e) {
+    typedef typename std::make_signed<word_type>::type signed_word;
+    I v = I(signed_word(word_type(w << epoch_bits)) >> epoch_bits);
+    I fresh = I((w >> value_bits) == e);
+    return (v & -fresh) | (fresh - 1);
+  }
+#ifdef CLUSTER_THREAD_SAFE
+  std::atomic<word_type> word_;
 #else
-  int parent_;
+  word_type word_;
 #endif
 };
 
-// thread-unsafe
+// counterpart of basic_forest whose reset() only advances the epoch, and nodes not updated since
+// then read as roots with weight = 1.  Initialization of nodes is thus folded into their first
+// update in unify, instead of writing all the nodes at the beginning of each sweep; all the
+// parent words are rewritten only once in max_epoch resets.  Nodes that are not updated in a
+// sweep keep a stale cluster id until assign_id or set_id.  More nodes than max_nodes of the
+// parent word throw std::length_error.
+template<typename I, class A = std::allocator<I>,
+         typename W = typename std::make_unsigned<I>::type>
+class basic_epoch_forest {
+public:
+  typedef basic_node<I> value_type;
+  typedef basic_epoch_parent_word<I, W> parent_type;
+  typedef typename parent_type::epoch_type epoch_type;
+  typedef A allocator_type;
+
+  class const_reference {
+  public:
+    const_reference(parent_type const& p, I const& id, epoch_type e) :
+      parent_(p), id_(id), epoch_(e) {}
+    bool is_root() const { return parent_.is_root(epoch_); }
+    I parent() const { return parent_.parent(epoch_); }
+    I weight() const { return parent_.weight(epoch_); }
+    I id() const { return id_; }
+    I next() const { return parent_.next(epoch_); }
+    operator value_type() const {
+      value_type n;
+      if (is_root()) n.set_weight(weight()); else n.set_parent(parent());
+      n.set_id(id_);
+      return n;
+    }
+  private:
+    parent_type const& parent_;
+    I const& id_;
+    epoch_type epoch_;
+  };
+
+  class reference {
+  public:
+    reference(parent_type& p, I& id, epoch_type e) : parent_(p), id_(id), epoch_(e) {}
+    reference& operator=(reference const& rhs) {
+      parent_.set_value(epoch_, rhs.parent_.value(rhs.epoch_));
+      id_ = rhs.id_;
+      return *this;
+    }
+    reference& operator=(value_type const& n) {
+      if (n.is_root()) set_weight(n.weight()); else set_parent(n.parent());
+      id_ = n.id();
+      return *this;
+    }
+    bool is_root() const { return parent_.is_root(epoch_); }
+    void set_parent(I parent) { parent_.set_parent(epoch_, parent); }
+    I parent() const { return parent_.parent(epoch_); }
+    void set_weight(I w) { parent_.set_weight(epoch_, w); }
+    I weight() const { return parent_.weight(epoch_); }
+    void set_id(I id) { id_ = id; }
+    I id() const { return id_; }
+    I next() const { return parent_.next(epoch_); }
+    void set_ancestor(I g) { parent_.set_ancestor(epoch_, g); }
+    bool try_link(I parent) { return parent_.try_link(epoch_, parent); }
+    bool replace_parent(I from, I to) { return parent_.replace_parent(epoch_, from, to); }
+    void add_weight(I w) { parent_.add_weight(epoch_, w); }
+#ifdef CLUSTER_THREAD_SAFE
+    I lock_root() { return parent_.lock_root(epoch_); }
+#endif
+    operator value_type() const { return const_reference(parent_, id_, epoch_); }
+  private:
+    parent_type& parent_;
+    I& id_;
+    epoch_type epoch_;
+  };
+
+  static const I max_nodes = parent_type::max_nodes;
+
+  explicit basic_epoch_forest(std::size_t n = 0) : parent_(check_size(n)), id_(n), epoch_(1) {}
+  std::size_t size() const { return parent_.size(); }
+  void resize(std::size_t n) {
+    parent_.resize(check_size(n));
+    id_.resize(n);
+  }
+  void clear() {
+    parent_.clear();
+    id_.clear();
+  }
+  // reset all the nodes to root with weight = 1
+  void reset() {
+    if (++epoch_ > parent_type::max_epoch) {
+      std::fill(parent_.begin(), parent_.end(), parent_type());
+      epoch_ = 1;
+    }
+  }
+  epoch_type epoch() const { return epoch_; }
+  void push_back(value_type const& n) {
+    check_size(size() + 1);
+    parent_.push_back(parent_type());
+    id_.push_back(0);
+    (*this)[size() - 1] = n;
+  }
+  // address of parent word (e.g. for prefetching)
+  void const* address(std::size_t i) const { return &parent_[i]; }
+  reference operator[](std::size_t i) { return reference(parent_[i], id_[i], epoch_); }
+  const_reference operator[](std::size_t i) const {
+    return const_reference(parent_[i], id_[i], epoch_);
+  }
+private:
+  static std::size_t check_size(std::size_t n) {
+    if (n > static_cast<std::size_t>(max_nodes))
+      throw std::length_error("basic_epoch_forest: too many nodes");
+    return n;
+  }
+  std::vector<parent_type,
+              typename std::allocator_traits<A>::template rebind_alloc<parent_type> > parent_;
+  std::vector<I, A> id_;
+  epoch_type epoch_;
+};
+
+// non-owning view of contiguous array of nodes, e.g. buffer allocated by custom allocator (see
+// huge_page_allocator.hpp), memory-mapped file, or slice of larger allocation.  Its size is
+// fixed, i.e. add() is not available.
 template<class T>
-inline int add(std::vector<T>& v) {
+class span {
+public:
+  typedef T value_type;
+  typedef T* iterator;
+  span() : data_(nullptr), size_(0) {}
+  span(T* data, std::size_t size) : data_(data), size_(size) {}
+  template<class A>
+  span(std::vector<T, A>& v) : data_(v.data()), size_(v.size()) {}
+  T* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  iterator begin() const { return data_; }
+  iterator end() const { return data_ + size_; }
+  T& operator[](std::size_t i) const { return data_[i]; }
+  // view of nodes [offset, offset+count); note that parent index is relative to the beginning of
+  // the view, so that unify should not be mixed on overlapping views with different offsets
+  span subspan(std::size_t offset, std::size_t count) const {
+    return span(data_ + offset, count);
+  }
+private:
+  T* data_;
+  std::size_t size_;
+};
+
+// default (32-bit) index
+typedef basic_parent_word<int> parent_word;
+typedef basic_node<int> node;
+typedef basic_node_noweight<int> node_noweight;
+typedef basic_forest<int> forest;
+
+// explicit index width: 64-bit for huge systems, 16-bit for compact small-lattice runs
+typedef basic_node<std::int16_t> node16;
+typedef basic_node<std::int32_t> node32;
+typedef basic_node<std::int64_t> node64;
+typedef basic_node_noweight<std::int16_t> node_noweight16;
+typedef basic_node_noweight<std::int32_t> node_noweight32;
+typedef basic_node_noweight<std::int64_t> node_noweight64;
+typedef basic_forest<std::int16_t> forest16;
+typedef basic_forest<std::int32_t> forest32;
+typedef basic_forest<std::int64_t> forest64;
+
+// forest with O(1) reset; up to 2^23 - 1 nodes for 32-bit index, or 2^31 - 1 with 64-bit parent
+// word (wide_epoch_forest)
+typedef basic_epoch_forest<int> epoch_forest;
+typedef basic_epoch_forest<std::int32_t> epoch_forest32;
+typedef basic_epoch_forest<std::int64_t> epoch_forest64;
+typedef basic_epoch_forest<int, std::allocator<int>, std::uint64_t> wide_epoch_forest;
+
+// array of nodes for applications that reset all the nodes every sweep: wide_epoch_forest if
+// CLUSTER_USE_EPOCH_RESET is defined, otherwise std::vector<node>.  The former saves the write
+// pass of reset, which pays off when the array is much larger than the last level cache, at the
+// cost of decoding the epoch on every access; its 64-bit parent words allow as many nodes as
+// std::vector<node>.  A is an allocator of node (rebound to int for wide_epoch_forest).
+#ifdef CLUSTER_USE_EPOCH_RESET
+template<class A = std::allocator<node> >
+using node_array =
+  basic_epoch_forest<int, typename std::allocator_traits<A>::template rebind_alloc<int>,
+                     std::uint64_t>;
+#else
+template<class A = std::allocator<node> >
+using node_array = std::vector<node, A>;
+#endif
+
+// index type of container of nodes
+template<class V>
+using index_t = typename V::value_type::index_type;
+
+// raw view of 32-bit parent words and ids used by the vectorized kernels in simd.hpp: parent word
+// and id of node i are found at parent(v)[i * stride] and id(v)[i * stride]
+template<class V>
+struct raw_nodes : std::false_type {};
+
+// contiguous array of basic_node<int>
+template<class V>
+struct raw_interleaved_nodes : std::true_type {
+  static_assert(sizeof(basic_node<int>) == 2 * sizeof(int), "unexpected layout of node");
+  static const int stride = 2;
+  static int* parent(V& v) { return reinterpret_cast<int*>(v.data()); }
+  static int* id(V& v) { return reinterpret_cast<int*>(v.data()) + 1; }
+};
+
+template<class A>
+struct raw_nodes<std::vector<basic_node<int>, A> >
+  : raw_interleaved_nodes<std::vector<basic_node<int>, A> > {};
+
+template<>
+struct raw_nodes<span<basic_node<int> > > : raw_interleaved_nodes<span<basic_node<int> > > {};
+
+template<class A>
+struct raw_nodes<basic_forest<int, A> > : std::true_type {
+  static_assert(sizeof(basic_parent_word<int>) == sizeof(int), "unexpected layout of forest");
+  static const int stride = 1;
+  static int* parent(basic_forest<int, A>& v) {
+    return reinterpret_cast<int*>(v.parent_data());
+  }
+  static int* id(basic_forest<int, A>& v) { return v.id_data(); }
+};
+
+// add new root node; storage grows through allocator A of the container (thread-unsafe)
+template<class T, class A>
+inline typename T::index_type add(std::vector<T, A>& v) {
   v.push_back(T());
   return v.size() - 1; // return index of new node
 }
 
-template<class T>
-inline int root_index(std::vector<T> const& v, int g) {
-#ifdef _OPENMP
-  T c = v[g];
-  while (!c.is_root()) {
-    g = c.parent();
-    c = v[g];
-  }
-#else
-  while (!v[g].is_root()) {
-    g = v[g].parent();
+// thread-unsafe
+template<typename I, class A>
+inline I add(basic_forest<I, A>& v) {
+  v.push_back(basic_node<I>());
+  return v.size() - 1; // return index of new node
+}
+
+// thread-unsafe
+template<typename I, class A, typename W>
+inline I add(basic_epoch_forest<I, A, W>& v) {
+  v.push_back(basic_node<I>());
+  return v.size() - 1; // return index of new node
+}
+
+// reset all the nodes to root with weight = 1
+template<class V>
+inline void reset(V& v) { std::fill(v.begin(), v.end(), typename V::value_type()); }
+
+template<typename I, class A>
+inline void reset(basic_forest<I, A>& v) { v.reset(); }
+
+// O(1) except once in max_epoch calls
+template<typename I, class A, typename W>
+inline void reset(basic_epoch_forest<I, A, W>& v) { v.reset(); }
+
+// parallel version of reset; each thread clears its own block of nodes
+template<class V>
+inline void reset_parallel(V& v) {
+  parallel::run([&](int t, int nt) {
+    auto first = parallel::block_begin<std::size_t>(0, v.size(), t, nt);
+    auto last = parallel::block_begin<std::size_t>(0, v.size(), t + 1, nt);
+    std::fill(v.begin() + first, v.begin() + last, typename V::value_type());
+  });
+}
+
+template<typename I, class A>
+inline void reset_parallel(basic_forest<I, A>& v) { v.reset(); }
+
+template<typename I, class A, typename W>
+inline void reset_parallel(basic_epoch_forest<I, A, W>& v) { v.reset(); }
+
+// find root by following parent links; reads only the parent word of each node on the path
+template<class V>
+inline index_t<V> root_index(V const& v, index_t<V> g) {
+  index_t<V> p;
+  CLUSTER_STATISTICS(std::uint64_t depth = 0);
+  while ((p = v[g].next()) >= 0) {
+    g = p;
+    CLUSTER_STATISTICS(++depth);
   }
-#endif
+  CLUSTER_STATISTICS(statistics::local().find_depth.add(depth));
   return g;
 }
 
 // root_index with path-halving
 // Note: this is not thread-safe, but is really safe as long as called from unify_*
-template<class T>
-inline int root_index_ph(std::vector<T>& v, int g) {
-  if (v[g].is_root()) return g;
+template<class V>
+inline index_t<V> root_index_ph(V& v, index_t<V> g) {
+  index_t<V> p = v[g].next();
+  CLUSTER_STATISTICS(std::uint64_t depth = 0);
+  if (p < 0) {
+    CLUSTER_STATISTICS(statistics::local().find_depth.add(depth));
+    return g;
+  }
   while (true) {
-    int p = v[g].parent();
-    if (v[p].is_root()) return p;
-    v[g].set_parent(v[p].parent());
+    CLUSTER_STATISTICS(++depth);
+    index_t<V> q = v[p].next();
+    if (q < 0) {
+      CLUSTER_STATISTICS(statistics::local().find_depth.add(depth));
+      return p;
+    }
+    v[g].set_ancestor(q);
     g = p;
+    p = q;
   }
 }
 
-template<class T>
-inline T const& root(std::vector<T> const& v, int g) { return v[root_index(v, g)]; }
+template<class V>
+inline auto root(V const& v, index_t<V> g) -> decltype(v[g]) { return v[root_index(v, g)]; }
 
-template<class T>
-inline T const& root(std::vector<T> const& v, T const& n) {
-  return n.is_root() ? n : root(v, n.parent());
+// returns a copy of the root node, since basic_forest gives nodes by proxy
+template<class V>
+inline typename V::value_type root(V const& v, typename V::value_type const& n) {
+  if (n.is_root()) return n;
+  return root(v, n.parent());
 }
 
-template<class T>
-inline int cluster_id(std::vector<T> const& v, int g) { return root(v, g).id(); }
+template<class V>
+inline index_t<V> cluster_id(V const& v, index_t<V> g) { return root(v, g).id(); }
 
-template<class T>
-inline int cluster_id(std::vector<T> const& v, T const& n) { return root(v, n).id(); }
+template<class V>
+inline index_t<V> cluster_id(V const& v, typename V::value_type const& n) {
+  return root(v, n).id();
+}
 
-template<class T>
-void set_root(std::vector<T>& v, int g) {
-#ifdef _OPENMP
+template<class V>
+void set_root(V& v, index_t<V> g) {
+#ifdef CLUSTER_THREAD_SAFE
   while(true) {
-    int r = root_index(v, g);
+    index_t<V> r = root_index(v, g);
     if (r == g) {
       return;
     } else {
-      int w = v[r].lock_root();
+      index_t<V> w = v[r].lock_root();
       if (w != 0) {
         v[g].set_weight(w);
         v[r].set_parent(g); // release lock
         return;
       }
+      CLUSTER_STATISTICS(++statistics::local().set_root_retries);
     }
   }
 #else
-  int r = root_index(v, g);
+  index_t<V> r = root_index(v, g);
   if (r != g) {
     v[g] = v[r];
     v[r].set_parent(g);
@@ -184,84 +719,335 @@ void set_root(std::vector<T>& v, int g) {
 #endif
 }
 
-template<class T>
-inline void update_link(std::vector<T>& v, int g, int r) {
+template<class V>
+inline void update_link(V& v, index_t<V> g, index_t<V> r) {
   while (g != r) {
-    int p = v[g].parent();
+    index_t<V> p = v[g].parent();
     v[g].set_parent(r);
     g = p;
   }
 }
 
+// linking rules for weighted union: roots r0 and r1 with weights w0 and w1 are swapped if r0
+// should be linked under r1, and the new root gets weight merge(w0, w1)
+struct by_weight {
+  static const bool maintains_weight = true;
+  template<typename I>
+  static bool swap_roots(I, I w0, I, I w1) { return w0 < w1; }
+  template<typename I>
+  static I merge(I w0, I w1) { return w0 + w1; }
+};
+
+// union by index: root with smaller index survives, so that the final root of each cluster is
+// its node with the smallest index, irrespective of the order of unify (and of thread
+// interleaving).  Weight is maintained as in by_weight.
+struct by_index {
+  static const bool maintains_weight = true;
+  template<typename I>
+  static bool swap_roots(I r0, I, I r1, I) { return r0 > r1; }
+  template<typename I>
+  static I merge(I w0, I w1) { return w0 + w1; }
+};
+
+// union by rank: weight() of root holds rank + 1 instead of cluster size
+struct by_rank {
+  static const bool maintains_weight = false;
+  template<typename I>
+  static bool swap_roots(I, I w0, I, I w1) { return w0 < w1; }
+  template<typename I>
+  static I merge(I w0, I w1) { return (w0 == w1) ? (w0 + 1) : std::max(w0, w1); }
+};
+
+//
+// union-find policies, selected by template argument of unify()
+//
+// thread_safe is true if unify() may be called concurrently on the same nodes (in the thread-safe
+// version); the others must be used by a single thread, e.g. not in parallel labeling
+//
+
+// full path compression after union
 // WARNING: this is not thread-safe
-template<class T>
-inline int unify_compress(std::vector<T>& v, int g0, int g1) {
-  using std::swap;
-  int r0 = root_index(v, g0);
-  int r1 = root_index(v, g1);
-  if (r0 != r1) {
-#if !defined(CLUSTER_USE_DETERMINISTIC_UNIFY)
-    if (v[r0].weight() < v[r1].weight()) swap(r0, r1);
+template<class RULE>
+struct compress {
+  static const bool maintains_weight = RULE::maintains_weight;
+  static const bool thread_safe = false;
+  template<class V>
+  static index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+    using std::swap;
+    index_t<V> r0 = root_index(v, g0);
+    index_t<V> r1 = root_index(v, g1);
+    if (r0 != r1) {
+      index_t<V> w0 = v[r0].weight();
+      index_t<V> w1 = v[r1].weight();
+      if (RULE::swap_roots(r0, w0, r1, w1)) {
+        swap(r0, r1);
+        swap(w0, w1);
+      }
+      v[r0].set_weight(RULE::merge(w0, w1));
+      v[r1].set_parent(r0);
+      CLUSTER_STATISTICS(++statistics::local().unify_merges);
+    }
+    update_link(v, g0, r0);
+    update_link(v, g1, r0);
+    return r0; // return (new) root node
+  }
+};
+
+// path-halving during find without locking roots, also in the thread-safe version; nodes
+// should be updated by a single thread only (e.g. tile of tiled_labeler)
+template<class RULE>
+struct pathhalving_local {
+  static const bool maintains_weight = RULE::maintains_weight;
+  static const bool thread_safe = false;
+  template<class V>
+  static index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+    using std::swap;
+    index_t<V> r0 = root_index_ph(v, g0);
+    index_t<V> r1 = root_index_ph(v, g1);
+    if (r0 != r1) {
+      index_t<V> w0 = v[r0].weight();
+      index_t<V> w1 = v[r1].weight();
+      if (RULE::swap_roots(r0, w0, r1, w1)) {
+        swap(r0, r1);
+        swap(w0, w1);
+      }
+      v[r0].set_weight(RULE::merge(w0, w1));
+      v[r1].set_parent(r0);
+      CLUSTER_STATISTICS(++statistics::local().unify_merges);
+    }
+    return r0; // return (new) root node
+  }
+};
+
+// path-halving during find; roots are locked by lock_root() in the thread-safe version
+template<class RULE>
+struct pathhalving {
+  static const bool maintains_weight = RULE::maintains_weight;
+  static const bool thread_safe = true;
+  template<class V>
+  static index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+#ifdef CLUSTER_THREAD_SAFE
+    using std::swap;
+    index_t<V> r0 = root_index_ph(v, g0);
+    index_t<V> r1 = root_index_ph(v, g1);
+    index_t<V> w0 = 0;
+    index_t<V> w1 = 0;
+    while (true) {
+      if (r1 == r0) return r0; // g0 and g1 belong to the same cluster
+      w0 = v[r0].lock_root();
+      w1 = v[r1].lock_root();
+      if (w0 != 0 && w1 != 0) break;
+      if (w0 != 0) v[r0].set_weight(w0); // release lock
+      if (w1 != 0) v[r1].set_weight(w1); // release lock
+      CLUSTER_STATISTICS(++statistics::local().unify_retries);
+      r0 = root_index_ph(v, r0);
+      r1 = root_index_ph(v, r1);
+    }
+    if (RULE::swap_roots(r0, w0, r1, w1)) {
+      swap(r0, r1);
+      swap(w0, w1);
+    }
+    v[r0].set_weight(RULE::merge(w0, w1)); // release lock
+    v[r1].set_parent(r0); // release lock
+    CLUSTER_STATISTICS(++statistics::local().unify_merges);
+    return r0; // return (new) root node
 #else
-    if (r0 > r1) swap(r0, r1);
+    return pathhalving_local<RULE>::unify(v, g0, g1);
 #endif
-    v[r0].set_weight(v[r0].weight() + v[r1].weight());
-    v[r1].set_parent(r0);
   }
-  update_link(v, g0, r0);
-  update_link(v, g1, r0);
-  return r0; // return (new) root node
-}
+};
 
-template<class T>
-inline int unify_pathhalving(std::vector<T>& v, int g0, int g1) {
-  using std::swap;
-  int r0 = root_index_ph(v, g0);
-  int r1 = root_index_ph(v, g1);
-#ifdef _OPENMP
-  int w0 = 0;
-  int w1 = 0;
-  while (true) {
-    if (r1 == r0) return r0; // g0 and g1 belong to the same cluster
-    w0 = v[r0].lock_root();
-    w1 = v[r1].lock_root();
-    if (w0 != 0 && w1 != 0) break;
-    if (w0 != 0) v[r0].set_weight(w0); // release lock
-    if (w1 != 0) v[r1].set_weight(w1); // release lock
-    r0 = root_index_ph(v, r0);
-    r1 = root_index_ph(v, r1);
-  }
-# if !defined(CLUSTER_USE_DETERMINISTIC_UNIFY)
-  if (w0 < w1) swap(r0, r1);
-# else
-  if (r0 > r1) swap(r0, r1);
-# endif
-  v[r0].set_weight(w0 + w1); // release lock
-  v[r1].set_parent(r0); // release lock
-#else
-  if (r0 != r1) {
-# if !defined(CLUSTER_USE_DETERMINISTIC_UNIFY)
-    if (v[r0].weight() < v[r1].weight()) swap(r0, r1);
-# else
-    if (r0 > r1) swap(r0, r1);
-# endif
-    v[r0].set_weight(v[r0].weight() + v[r1].weight());
-    v[r1].set_parent(r0);
+// Rem's algorithm with splicing; parent has always larger index than its child, and nodes on
+// the path are spliced to the other tree while climbing.  Lock-free in the thread-safe version.
+// Weight is not maintained.  Returns a node in the merged cluster, which is not always root.
+// Reference:
+//   M. M. A. Patwary, J. Blair, and F. Manne,
+//   `Experiments on Union-Find Algorithms for the Disjoint-Set Data Structure',
+//   Lecture Notes in Computer Science 6049, 411 (2010).
+struct rem_splicing {
+  static const bool maintains_weight = false;
+  static const bool thread_safe = true;
+  template<class V>
+  static index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+    using std::swap;
+    while (true) {
+      index_t<V> p0 = v[g0].next();
+      index_t<V> p1 = v[g1].next();
+      if (p0 < 0) p0 = g0;
+      if (p1 < 0) p1 = g1;
+      if (p0 == p1) return p0;
+      if (p0 > p1) {
+        swap(g0, g1);
+        swap(p0, p1);
+      }
+      if (g0 == p0) {
+        if (v[g0].try_link(p1)) {
+          CLUSTER_STATISTICS(++statistics::local().unify_merges);
+          return p1;
+        }
+        CLUSTER_STATISTICS(++statistics::local().unify_retries);
+      } else {
+        v[g0].replace_parent(p0, p1); // splicing (may fail harmlessly under contention)
+        g0 = p0;
+      }
+    }
   }
+};
+
+// link by index: root with smaller index is linked under the other by compare-and-swap, without
+// locking roots.  Weight is not maintained.
+struct link_by_index {
+  static const bool maintains_weight = false;
+  static const bool thread_safe = true;
+  template<class V>
+  static index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+    using std::swap;
+    index_t<V> r0 = root_index_ph(v, g0);
+    index_t<V> r1 = root_index_ph(v, g1);
+    while (r0 != r1) {
+      if (r0 < r1) swap(r0, r1);
+      if (v[r1].try_link(r0)) {
+        CLUSTER_STATISTICS(++statistics::local().unify_merges);
+        break;
+      }
+      CLUSTER_STATISTICS(++statistics::local().unify_retries);
+      r0 = root_index_ph(v, r0);
+      r1 = root_index_ph(v, r1);
+    }
+    return r0; // return (new) root node
+  }
+};
+
+typedef compress<by_weight> compress_by_weight;
+typedef compress<by_rank> compress_by_rank;
+typedef pathhalving<by_weight> pathhalving_by_weight;
+typedef pathhalving<by_rank> pathhalving_by_rank;
+typedef compress<by_index> compress_by_index;
+typedef pathhalving<by_index> pathhalving_by_index;
+
+// deterministic labeling: roots, weights and cluster id given by assign_id are the same for
+// serial and parallel execution with any number of threads
+typedef pathhalving_by_index deterministic_unify_policy;
+
+// linking rule of unify_compress and unify_pathhalving, and of the default policy
+#if !defined(CLUSTER_USE_DETERMINISTIC_UNIFY)
+typedef by_weight default_rule;
+#else
+typedef by_index default_rule;
+#endif
+
+// default policy can be changed at compile time, e.g. -DCLUSTER_UNIFY_POLICY=rem_splicing, or
+// -DCLUSTER_USE_DETERMINISTIC_UNIFY for deterministic_unify_policy
+#ifndef CLUSTER_UNIFY_POLICY
+# define CLUSTER_UNIFY_POLICY pathhalving<default_rule>
 #endif
-  return r0; // return (new) root node
+typedef CLUSTER_UNIFY_POLICY default_unify_policy;
+
+template<class V>
+inline index_t<V> unify_compress(V& v, index_t<V> g0, index_t<V> g1) {
+  return compress<default_rule>::unify(v, g0, g1);
 }
 
-template<class T>
-inline int unify(std::vector<T>& v, int g0, int g1) {
-  return unify_pathhalving(v, g0, g1);
+template<class V>
+inline index_t<V> unify_pathhalving(V& v, index_t<V> g0, index_t<V> g1) {
+  return pathhalving<default_rule>::unify(v, g0, g1);
 }
 
-template<class T>
-inline void output(std::vector<T> const& v, std::ostream& os = std::cout) {
-  for (int i = 0; i < v.size(); ++i) {
+template<class POLICY = default_unify_policy, class V>
+inline index_t<V> unify(V& v, index_t<V> g0, index_t<V> g1) {
+  CLUSTER_STATISTICS(++statistics::local().unify_calls);
+  return POLICY::unify(v, g0, g1);
+}
+
+// address of node g
+template<class V>
+inline void const* node_address(V const& v, index_t<V> g) { return &v[g]; }
+
+template<typename I, class A>
+inline void const* node_address(basic_forest<I, A> const& v, I g) { return v.address(g); }
+
+template<typename I, class A, typename W>
+inline void const* node_address(basic_epoch_forest<I, A, W> const& v, I g) { return v.address(g); }
+
+// software prefetch of node g
+template<class V>
+inline void prefetch(V const& v, index_t<V> g) {
+#if defined(__GNUC__)
+  __builtin_prefetch(node_address(v, g));
+#endif
+}
+
+// unify pairs of nodes (e.g. std::vector<std::pair<int, int> >) in order.  Finds of several
+// pairs are kept in flight, and each node on their paths is prefetched one step ahead, so that
+// cache misses of independent finds overlap.  Pairs are committed by unify() in the original
+// order, starting from the nodes found so far, which gives the same clusters (and, for the
+// weighted policies, the same roots and weights) as calling unify() for each pair.
+template<class POLICY = default_unify_policy, class V, class PAIRS>
+void unify_batch(V& v, PAIRS const& pairs) {
+  const std::size_t depth = 16; // number of pairs in flight
+  index_t<V> g0[depth], g1[depth];
+  std::size_t n = pairs.size();
+  std::size_t head = 0, tail = 0;
+  while (head < n) {
+    for (; tail < n && tail - head < depth; ++tail) {
+      std::size_t k = tail % depth;
+      g0[k] = pairs[tail].first;
+      g1[k] = pairs[tail].second;
+      prefetch(v, g0[k]);
+      prefetch(v, g1[k]);
+    }
+    for (std::size_t i = head; i < tail; ++i) {
+      std::size_t k = i % depth;
+      index_t<V> p0 = v[g0[k]].next();
+      if (p0 >= 0) {
+        g0[k] = p0;
+        prefetch(v, p0);
+      }
+      index_t<V> p1 = v[g1[k]].next();
+      if (p1 >= 0) {
+        g1[k] = p1;
+        prefetch(v, p1);
+      }
+    }
+    for (; head < tail; ++head) {
+      std::size_t k = head % depth;
+      if (!v[g0[k]].is_root() || !v[g1[k]].is_root()) break;
+      CLUSTER_STATISTICS(++statistics::local().unify_calls);
+      POLICY::unify(v, g0[k], g1[k]);
+    }
+  }
+}
+
+// recalculate weight (cluster size) of all the roots
+template<class V>
+void recount_weight(V& v) {
+  index_t<V> n = v.size();
+  parallel::for_each(index_t<V>(0), n, [&](index_t<V> i) {
+    if (v[i].is_root()) v[i].set_weight(1);
+  });
+  parallel::for_each(index_t<V>(0), n, [&](index_t<V> i) {
+    if (!v[i].is_root()) v[root_index(v, i)].add_weight(1);
+  });
+}
+
+template<class V>
+inline void update_weight(V&, std::true_type) {}
+
+template<class V>
+inline void update_weight(V& v, std::false_type) { recount_weight(v); }
+
+// make weight() of roots give cluster size after unify with policies that do not maintain it;
+// no-op for the others
+template<class POLICY = default_unify_policy, class V>
+inline void update_weight(V& v) {
+  update_weight(v, std::integral_constant<bool, POLICY::maintains_weight>());
+}
+
+template<class V>
+inline void output(V const& v, std::ostream& os = std::cout) {
+  for (index_t<V> i = 0; i < v.size(); ++i) {
     os << "node " << i << ": ";
-    int g = i;
+    index_t<V> g = i;
     if (v[g].is_root()) {
       os << "root (id = " << v[g].id() << ")" << std::endl;
     } else {
@@ -278,94 +1064,194 @@ inline void output(std::vector<T> const& v, std::ostream& os = std::cout) {
   }
 }
 
-template<typename T>
-int count_root(std::vector<T>& v, int start, int n) {
-  int nc = 0;
-  for (int i = start; i < start + n; ++i)
+// count_root, set_id and copy_id use vectorized kernels for std::vector<node> and forest, unless
+// they are too large for 32-bit offsets (see cluster/simd.hpp)
+template<typename V>
+index_t<V> count_root(V& v, index_t<V> start, index_t<V> n, std::false_type) {
+  index_t<V> nc = 0;
+  for (index_t<V> i = start; i < start + n; ++i)
     if (v[i].is_root()) ++nc;
   return nc;
 }
 
-template<typename T>
-int count_root_p(std::vector<T>& v, int start, int n) {
-  int nc = 0;
-  #pragma omp for schedule(static) nowait
-  for (int i = start; i < start + n; ++i)
-    if (v[i].is_root()) ++nc;
-  return nc;
+template<typename V>
+index_t<V> count_root(V& v, index_t<V> start, index_t<V> n, std::true_type) {
+  if (!simd::fits(v.size(), raw_nodes<V>::stride))
+    return count_root(v, start, n, std::false_type());
+  return simd::count_root(raw_nodes<V>::parent(v), raw_nodes<V>::stride, start, n);
 }
 
-template<typename T>
-int set_id(std::vector<T>& v, int start, int n, int nc) {
-  for (int i = start; i < start + n; ++i)
-    if (v[i].is_root()) v[i].set_id(nc++);
-  return nc;
+template<typename V>
+index_t<V> count_root(V& v, index_t<V> start, index_t<V> n) {
+  return count_root(v, start, n, raw_nodes<V>());
+}
+
+// *_p: to be called by all the threads in a parallel region (e.g. parallel::run); each thread
+// takes its own block of [start, start+n)
+template<typename V>
+index_t<V> count_root_p(V& v, index_t<V> start, index_t<V> n) {
+  int t = parallel::thread_num();
+  int nt = parallel::num_threads();
+  index_t<V> first = parallel::block_begin<index_t<V> >(start, start + n, t, nt);
+  index_t<V> last = parallel::block_begin<index_t<V> >(start, start + n, t + 1, nt);
+  return count_root(v, first, last - first);
 }
 
-template<typename T>
-int set_id_p(std::vector<T>& v, int start, int n, int nc) {
-  #pragma omp for schedule(static) nowait
-  for (int i = start; i < start + n; ++i)
+template<typename V>
+index_t<V> set_id(V& v, index_t<V> start, index_t<V> n, index_t<V> nc, std::false_type) {
+  for (index_t<V> i = start; i < start + n; ++i)
     if (v[i].is_root()) v[i].set_id(nc++);
   return nc;
 }
 
-template<typename T>
-void copy_id(std::vector<T>& v, int start, int n) {
-  for (int i = start; i < start + n; ++i)
-    v[i].set_id(cluster_id(v, i));
+template<typename V>
+index_t<V> set_id(V& v, index_t<V> start, index_t<V> n, index_t<V> nc, std::true_type) {
+  if (!simd::fits(v.size(), raw_nodes<V>::stride))
+    return set_id(v, start, n, nc, std::false_type());
+  return simd::set_id(raw_nodes<V>::parent(v), raw_nodes<V>::id(v), raw_nodes<V>::stride,
+                      start, n, nc);
+}
+
+template<typename V>
+index_t<V> set_id(V& v, index_t<V> start, index_t<V> n, index_t<V> nc) {
+  return set_id(v, start, n, nc, raw_nodes<V>());
+}
+
+template<typename V>
+index_t<V> set_id_p(V& v, index_t<V> start, index_t<V> n, index_t<V> nc) {
+  int t = parallel::thread_num();
+  int nt = parallel::num_threads();
+  index_t<V> first = parallel::block_begin<index_t<V> >(start, start + n, t, nt);
+  index_t<V> last = parallel::block_begin<index_t<V> >(start, start + n, t + 1, nt);
+  return set_id(v, first, last - first, nc);
+}
+
+template<typename V>
+void copy_id(V& v, index_t<V> start, index_t<V> n, std::false_type) {
+  for (index_t<V> i = start; i < start + n; ++i)
+    if (!v[i].is_root()) v[i].set_id(cluster_id(v, i));
 }
 
-template<typename T>
-void copy_id_p(std::vector<T>& v, int start, int n) {
-  #pragma omp for schedule(static) nowait
-  for (int i = start; i < start + n; ++i)
-    v[i].set_id(cluster_id(v, i));
+template<typename V>
+void copy_id(V& v, index_t<V> start, index_t<V> n, std::true_type) {
+  if (!simd::fits(v.size(), raw_nodes<V>::stride)) return copy_id(v, start, n, std::false_type());
+  simd::copy_id(raw_nodes<V>::parent(v), raw_nodes<V>::id(v), raw_nodes<V>::stride, start, n);
+}
+
+// copy id of roots to the other nodes in [start, start+n).  Roots are never written, so that
+// ranges may be processed concurrently once id of all the roots has been set.
+template<typename V>
+void copy_id(V& v, index_t<V> start, index_t<V> n) {
+#ifdef CLUSTER_ENABLE_STATISTICS
+  for (index_t<V> i = start; i < start + n; ++i) {
+    std::uint64_t depth = 0;
+    for (index_t<V> g = v[i].next(); g >= 0; g = v[g].next()) ++depth;
+    statistics::local().tree_depth.add(depth);
+  }
+#endif
+  copy_id(v, start, n, raw_nodes<V>());
 }
 
-template<typename T>
-inline void pack_tree(std::vector<T>& v, int n) {
-#ifdef _OPENMP
-  int g, w; // workaround for FCC OpenMP bug? -- ST 2010-11-22
-  #pragma omp parallel for schedule(static) private(g, w)
-  for (int i = 0; i < n; ++i) {
+template<typename V>
+void copy_id_p(V& v, index_t<V> start, index_t<V> n) {
+  int t = parallel::thread_num();
+  int nt = parallel::num_threads();
+  index_t<V> first = parallel::block_begin<index_t<V> >(start, start + n, t, nt);
+  index_t<V> last = parallel::block_begin<index_t<V> >(start, start + n, t + 1, nt);
+  copy_id(v, first, last - first);
+}
+
+// assign consecutive cluster id to roots in [start, start+n) in index order and copy it to all
+// the nodes in the range; returns number of clusters.  In the thread-safe version, roots are
+// counted per block, offsets of blocks are given by exclusive prefix sum, and then id is assigned
+// and copied in parallel.  The resulting id does not depend on the number of threads.
+template<typename V>
+index_t<V> assign_id(V& v, index_t<V> start, index_t<V> n) {
+#ifdef CLUSTER_THREAD_SAFE
+  // blocks are fixed beforehand, so that they do not depend on the number of threads that
+  // actually join each of the parallel regions below
+  int nb = parallel::max_threads();
+  auto first = [&](int b) { return parallel::block_begin<index_t<V> >(start, start + n, b, nb); };
+  auto size = [&](int b) { return first(b + 1) - first(b); };
+  std::vector<index_t<V> > offset(nb + 1, 0);
+  parallel::run([&](int t, int nt) {
+    for (int b = t; b < nb; b += nt) offset[b + 1] = count_root(v, first(b), size(b));
+  });
+  for (int b = 0; b < nb; ++b) offset[b + 1] += offset[b];
+  parallel::run([&](int t, int nt) {
+    for (int b = t; b < nb; b += nt) set_id(v, first(b), size(b), offset[b]);
+  });
+  parallel::run([&](int t, int nt) {
+    for (int b = t; b < nb; b += nt) copy_id(v, first(b), size(b));
+  });
+  return offset[nb];
+#else
+  index_t<V> nc = set_id(v, start, n, 0);
+  copy_id(v, start, n);
+  return nc;
+#endif
+}
+
+template<typename V>
+index_t<V> assign_id(V& v) { return assign_id(v, 0, v.size()); }
+
+// let every non-root node point directly to its root (pointer jumping)
+template<typename V>
+void flatten(V& v) {
+  parallel::for_each(index_t<V>(0), index_t<V>(v.size()), [&](index_t<V> i) {
+    if (!v[i].is_root()) v[i].set_ancestor(root_index(v, i));
+  });
+}
+
+template<typename V>
+inline void pack_tree(V& v, index_t<V> n) {
+#ifdef CLUSTER_THREAD_SAFE
+  parallel::for_each(index_t<V>(0), n, [&](index_t<V> i) {
     if (!v[i].is_root()) {
-      g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n) {
           // encounter node with index < n
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n
-          w = v[g].lock_root();
+          index_t<V> w = v[g].lock_root();
           if (w != 0) {
             v[i].set_weight(w);
             v[g].set_parent(i); // release lock
+            CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
             break;
           }
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
-  }
+  });
 #else
-  for (int i = 0; i < n; ++i) {
+  for (index_t<V> i = 0; i < n; ++i) {
     if (!v[i].is_root()) {
-      int g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n) {
           // encounter node with index < n
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n
           v[i] = v[g];
           v[g].set_parent(i);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
@@ -374,91 +1260,104 @@ inline void pack_tree(std::vector<T>& v, int n) {
 }
 
 // pack tree so that nodes with id [0...n) and [m...) come upper
-template<typename T>
-inline void pack_tree(std::vector<T>& v, int n, int m) {
-#ifdef _OPENMP
-  int g, w; // workaround for FCC OpenMP bug? -- ST 2010-11-22
-  #pragma omp parallel for schedule(static) private(g, w)
-  for (int i = 0; i < n; ++i) {
+template<typename V>
+inline void pack_tree(V& v, index_t<V> n, index_t<V> m) {
+#ifdef CLUSTER_THREAD_SAFE
+  parallel::for_each(index_t<V>(0), n, [&](index_t<V> i) {
     if (!v[i].is_root()) {
-      g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n || g >= m) {
           // encounter node with index < n or >= m
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n and < m
-          w = v[g].lock_root();
+          index_t<V> w = v[g].lock_root();
           if (w != 0) {
             v[i].set_weight(w);
             v[g].set_parent(i); // release lock
+            CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
             break;
           }
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
-  }
-  #pragma omp parallel for schedule(static) private(g, w)
-  for (int i = m; i < m + n; ++i) {
+  });
+  parallel::for_each(m, m + n, [&](index_t<V> i) {
     if (!v[i].is_root()) {
-      g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n || g >= m) {
           // encounter node with index < n or >= m
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n and < m
-          w = v[g].lock_root();
+          index_t<V> w = v[g].lock_root();
           if (w != 0) {
             v[i].set_weight(w);
             v[g].set_parent(i); // release lock
+            CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
             break;
           }
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
-  }
+  });
 #else
-  for (int i = 0; i < n; ++i) {
+  for (index_t<V> i = 0; i < n; ++i) {
     if (!v[i].is_root()) {
-      int g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n || g >= m) {
           // encounter node with index < n or >= m
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n and < m
           v[i] = v[g];
           v[g].set_parent(i);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
   }
-  for (int i = m; i < m + n; ++i) {
+  for (index_t<V> i = m; i < m + n; ++i) {
     if (!v[i].is_root()) {
-      int g = v[i].parent();
+      index_t<V> g = v[i].parent();
+      CLUSTER_STATISTICS(std::uint64_t walk = 0);
       while (true) {
         if (g < n || g >= m) {
           // encounter node with index < n or >= m
           v[i].set_parent(g);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else if (v[g].is_root()) {
           // found root with index >= n and < m
           v[i] = v[g];
           v[g].set_parent(i);
+          CLUSTER_STATISTICS(statistics::local().pack_walk.add(walk));
           break;
         } else {
           g = v[g].parent();
+          CLUSTER_STATISTICS(++walk);
         }
       }
     }
@@ -0,0 +1,105 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// D-dimensional hypercubic lattice whose bonds are computed instead of stored
+//
+// Site index is s = x_0 + L x_1 + ... + L^{D-1} x_{D-1}, and bond b = D s + k connects s and its
+// neighbor in +k direction, i.e. the same numbering as lattice::graph::simple(D, L), which can be
+// replaced by hypercubic<D> (num_sites(), num_bonds(), source(b) and target(b)).  With periodic
+// boundary conditions, the neighbor wraps around along each axis; with helical ones, it is
+// s + L^k modulo the number of sites.  opposite_neighbor(s, k) gives the neighbor in -k direction,
+// which single-cluster growth needs in addition.  The remainder needed for wrapping is computed by
+// multiplication (Lemire's fastmod) instead of division.
+//
+// Example:
+//   dispatch_dimension(dim, [&](auto d) { run(hypercubic<decltype(d)::value>(L)); });
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+enum class boundary_type { periodic, helical };
+
+template<int D>
+class hypercubic {
+public:
+  static_assert(D >= 1, "dimension should be positive");
+  static const int dimension = D;
+
+  hypercubic(std::size_t length, boundary_type boundary = boundary_type::periodic) :
+    length_(length), boundary_(boundary) {
+    stride_[0] = 1;
+    for (int k = 0; k < D; ++k) {
+      stride_[k + 1] = stride_[k] * length;
+      multiplier_[k] = ~std::uint64_t(0) / stride_[k + 1] + 1;
+    }
+  }
+
+  std::size_t length() const { return length_; }
+  boundary_type boundary() const { return boundary_; }
+  std::size_t num_sites() const { return stride_[D]; }
+  std::size_t num_bonds() const { return D * num_sites(); }
+  std::size_t source(std::size_t b) const { return b / D; }
+  std::size_t target(std::size_t b) const { return neighbor(b / D, b % D); }
+
+  // neighbor of site s in +k direction
+  std::size_t neighbor(std::size_t s, int k) const {
+    std::size_t t = s + stride_[k];
+    if (boundary_ == boundary_type::helical) return (t >= num_sites()) ? t - num_sites() : t;
+    // x_k = L - 1 iff (s mod L^{k+1}) >= (L - 1) L^k; no remainder needed for the last axis
+    std::size_t r = (k == D - 1) ? s : remainder(s, k);
+    return (r >= stride_[k + 1] - stride_[k]) ? t - stride_[k + 1] : t;
+  }
+
+  // neighbor of site s in -k direction
+  std::size_t opposite_neighbor(std::size_t s, int k) const {
+    if (boundary_ == boundary_type::helical)
+      return (s >= stride_[k]) ? s - stride_[k] : s + num_sites() - stride_[k];
+    // x_k = 0 iff (s mod L^{k+1}) < L^k
+    std::size_t r = (k == D - 1) ? s : remainder(s, k);
+    return (r < stride_[k]) ? s + stride_[k + 1] - stride_[k] : s - stride_[k];
+  }
+
+private:
+  // a mod L^{k+1} by two multiplications for a < 2^32 (Lemire's fastmod), or by division
+  std::size_t remainder(std::size_t a, int k) const {
+#ifdef __SIZEOF_INT128__
+    if (num_sites() <= (std::size_t(1) << 32)) {
+      std::uint64_t low = multiplier_[k] * a;
+      return static_cast<std::size_t>((static_cast<unsigned __int128>(low) * stride_[k + 1]) >> 64);
+    }
+#endif
+    return a % stride_[k + 1];
+  }
+
+  std::size_t length_;
+  boundary_type boundary_;
+  std::size_t stride_[D + 1]; // L^k
+  std::uint64_t multiplier_[D]; // 2^64 / L^{k+1} rounded up
+};
+
+// maximum dimension supported by dispatch_dimension
+static const int max_dimension = 4;
+
+// calls f(std::integral_constant<int, D>()) for dim = D in [1, max_dimension]; returns false if
+// dim is out of range
+template<class F>
+bool dispatch_dimension(int dim, F const& f) {
+  switch (dim) {
+  case 1: f(std::integral_constant<int, 1>()); return true;
+  case 2: f(std::integral_constant<int, 2>()); return true;
+  case 3: f(std::integral_constant<int, 3>()); return true;
+  case 4: f(std::integral_constant<int, 4>()); return true;
+  default: return false;
+  }
+}
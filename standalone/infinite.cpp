@@ -18,11 +18,14 @@
 #include <algorithm>
 #include <iostream>
 #include <random>
+#include <utility>
 #include <vector>
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
 #include <lattice/graph.hpp>
+#include <cluster/finalize.hpp>
+#include <cluster/huge_page_allocator.hpp>
 #include <cluster/union_find.hpp>
 #include "infinite_options.hpp"
 
@@ -48,7 +51,10 @@ int main(int argc, char* argv[]) {
 
   // cluster information
   typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
+  typedef cluster::huge_page_allocator<fragment_t> allocator_t;
+  typedef cluster::union_find::node_array<allocator_t> fragments_t;
+  fragments_t fragments(lattice.num_sites());
+  std::vector<std::pair<int, int> > pairs; // pairs of sites to be unified
   std::vector<bool> flip(lattice.num_sites());
 
   // observables
@@ -61,32 +67,22 @@ int main(int argc, char* argv[]) {
   standards::timer tm;
   for (unsigned int mcs = 0; mcs < p.therm + p.sweeps; ++mcs) {
     // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
+    reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
     // cluster generation
+    pairs.clear();
     for (double t = r_time(eng); t < 1; t += r_time(eng)) {
       int s0 = lattice.num_sites() * r_uniform01(eng);
       int s1 = lattice.num_sites() * r_uniform01(eng);
-      if (spins[s0] == spins[s1]) unify(fragments, s0, s1);
+      if (spins[s0] == spins[s1]) pairs.push_back(std::make_pair(s0, s1));
     }
+    unify_batch(fragments, pairs);
+    update_weight(fragments); // no-op unless unify policy does not maintain weight
 
-    // assign cluster id & accumulate cluster properties
-    int nc = 0;
-    double mag2 = 0, mag4 = 0;
-    for (auto& f : fragments) {
-      if (f.is_root()) {
-        f.set_id(nc++);
-        double w = f.weight();
-        mag2 += power2(w);
-        mag4 += power4(w);
-      }
-    }
-    for (auto& f : fragments) f.set_id(cluster_id(fragments, f));
-
-    // flip spins
-    for (int c = 0; c < nc; ++c) flip[c] = (r_uniform01(eng) < 0.5);
-    for (int s = 0; s < lattice.num_sites(); ++s)
-      if (flip[fragments[s].id()]) spins[s] ^= 1;
+    // assign cluster id, accumulate cluster properties & flip spins
+    cluster::union_find::weight_moments<2, 4> m;
+    int nc = finalize(fragments, m, [&](int c, int) { flip[c] = (r_uniform01(eng) < 0.5); },
+                      [&](int s, int c) { if (flip[c]) spins[s] ^= 1; });
 
     double mu = 0;
     for (int s = 0; s < lattice.num_sites(); ++s) mu += 2 * spins[s] - 1;
@@ -96,14 +92,15 @@ int main(int argc, char* argv[]) {
       magnetization_unimp << mu;
       magnetization2_unimp << power2(mu);
       magnetization4_unimp << power4(mu);
-      magnetization2 << mag2;
-      magnetization4 << (3 * power2(mag2) - 2 * mag4);
+      magnetization2 << m.sum<2>();
+      magnetization4 << (3 * power2(m.sum<2>()) - 2 * m.sum<4>());
     }
   }
 
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
             << "Speed = " << (p.therm + p.sweeps) / elapsed << " MCS/sec\n";
+  cluster::statistics::print(std::clog);
   std::cout << num_clusters << std::endl
             << magnetization_unimp << std::endl
             << magnetization2_unimp << std::endl
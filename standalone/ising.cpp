@@ -9,7 +9,7 @@
 *
 *****************************************************************************/
 
-// Swendsen-Wang Cluster Algorithm for Square-Lattice Ising Model
+// Swendsen-Wang Cluster Algorithm for Hypercubic-Lattice Ising Model
 
 #ifndef ALPS_INDEP_SOURCE
 # define ALPS_INDEP_SOURCE
@@ -17,39 +17,156 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <random>
+#include <string>
+#include <utility>
 #include <vector>
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
-#include <lattice/graph.hpp>
+#include <cluster/autotune.hpp>
+#include <cluster/bernoulli.hpp>
+#include <cluster/finalize.hpp>
+#include <cluster/geometric_skip.hpp>
+#include <cluster/huge_page_allocator.hpp>
+#include <cluster/run_length.hpp>
+#include <cluster/single_cluster.hpp>
+#include <cluster/tiled_labeler.hpp>
 #include <cluster/union_find.hpp>
+#include "ising_multispin.hpp"
+#include "site_order.hpp"
 #include "ising_options.hpp"
 
 using standards::power2;
 using standards::power4;
+using cluster::union_find::run_collector;
+using cluster::union_find::unify;
+using cluster::union_find::unify_batch;
+using cluster::union_find::update_weight;
+using cluster::union_find::weight_moments;
 
-int main(int argc, char* argv[]) {
-  std::cout << "Swendsen-Wang Cluster Algorithm for Square Lattice Potts Model\n";
-  options p(argc, argv);
-  if (!p.valid) std::exit(127);
+template<class LATTICE>
+void simulate(options const& p, LATTICE const& lattice) {
   double prob = 1 - std::exp(-2 / p.temperature);
 
-  // square lattice
-  auto lattice = lattice::graph::simple(2, p.length);
+  // random number generators; one stream per thread in parallel sweep
+  std::vector<std::mt19937> engines;
+  if (p.parallel) {
+    for (int t = 0; t < cluster::parallel::max_threads(); ++t) {
+      std::seed_seq seq{ p.seed, static_cast<unsigned int>(t) };
+      engines.emplace_back(seq);
+    }
+  } else {
+    engines.emplace_back(p.seed);
+  }
+  auto r_uniform01 = [&](int t) { return std::uniform_real_distribution<>()(engines[t]); };
+
+  // bond activation by integer threshold with -i (see cluster/bernoulli.hpp); copied by each
+  // thread in every sweep, since it buffers engine output
+  cluster::bernoulli activate(prob, p.threshold_bits);
+  if (p.threshold_bits)
+    std::clog << "Effective Bond Probability = " << activate.probability() << " (error "
+              << activate.probability() - prob << ")\n";
 
-  // random number generators
-  std::mt19937 eng(p.seed);
-  std::uniform_real_distribution<> r_uniform01;
+  // f(t, nt) is called by all the threads in parallel sweep, or as f(0, 1) otherwise.  Bonds,
+  // sites and clusters are divided into contiguous blocks, one per thread.
+  auto run = [&](auto const& f) { if (p.parallel) cluster::parallel::run(f); else f(0, 1); };
+  auto block = [](int n, int t, int nt) { return cluster::parallel::block_begin(0, n, t, nt); };
+  int nb = lattice.num_bonds();
+  int ns = lattice.num_sites();
 
-  // spin configuration
-  std::vector<int> spins(lattice.num_sites(), 1);
+  // spin configuration (packed in multispin otherwise)
+  std::vector<int> spins(p.multispin ? 0 : lattice.num_sites(), 1);
+  std::unique_ptr<ising_multispin> multispin(
+    p.multispin ? new ising_multispin(LATTICE::dimension, p.length) : nullptr);
+  std::mt19937_64 eng64(p.seed); // for multispin
 
   // cluster information
   typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
-  std::vector<int> flip(lattice.num_sites());
+  typedef cluster::huge_page_allocator<fragment_t> allocator_t;
+  typedef cluster::union_find::node_array<allocator_t> fragments_t;
+  fragments_t fragments(p.tile ? 0 : lattice.num_sites());
+  std::vector<int> flip(p.multispin ? 0 : lattice.num_sites());
+
+  // two-level cluster labeling (optional)
+  typedef cluster::union_find::tiled_labeler<fragment_t, allocator_t> labeler_t;
+  std::unique_ptr<labeler_t> labeler(p.tile ? new labeler_t(lattice, p.tile) : nullptr);
+  std::vector<char> active(p.tile ? lattice.num_bonds() : 0);
+
+  // active bonds not in runs, per thread (run-length collapsing)
+  std::vector<std::vector<std::pair<int, int> > > pending(engines.size());
+
+  // satisfied bonds, compacted in the block of each thread (geometric skipping)
+  std::vector<int> satisfied(p.skip ? nb : 0);
+
+  // calls f(b) for the active bonds in block t in increasing order, and returns the number of
+  // satisfied bonds in the block.  With -g, satisfied bonds are first compacted without branch,
+  // and then active ones are picked by geometric skipping (see cluster/geometric_skip.hpp), which
+  // draws a random number per active bond instead of per satisfied one.
+  auto for_each_active = [&](int t, int nt, auto const& f) {
+    int first = block(nb, t, nt), last = block(nb, t + 1, nt);
+    int n = 0;
+    if (!p.skip) {
+      cluster::bernoulli coin = activate;
+      for (int b = first; b < last; ++b) {
+        bool sat = (spins[lattice.source(b)] == spins[lattice.target(b)]);
+        n += sat;
+        if (sat && coin(engines[t])) f(b);
+      }
+    } else {
+      for (int b = first; b < last; ++b) {
+        satisfied[first + n] = b;
+        n += (spins[lattice.source(b)] == spins[lattice.target(b)]);
+      }
+      cluster::geometric_skip(prob).for_each_success(n, engines[t],
+        [&](std::uint64_t i) { f(satisfied[first + i]); });
+    }
+    return n;
+  };
+
+  // number of satisfied bonds without cluster generation
+  auto count_satisfied = [&]() {
+    std::vector<int> nsat(engines.size(), 0);
+    run([&](int t, int nt) {
+      int n = 0;
+      for (int b = block(nb, t, nt); b < block(nb, t + 1, nt); ++b)
+        n += (spins[lattice.source(b)] == spins[lattice.target(b)]);
+      nsat[t] = n;
+    });
+    return std::accumulate(nsat.begin(), nsat.end(), 0);
+  };
+
+  // single-cluster update (-c); spins of the cluster are flipped after it is grown, and the
+  // number of satisfied bonds and the magnetization are updated from the bonds on its boundary
+  std::unique_ptr<cluster::single_cluster> wolff(p.wolff ? new cluster::single_cluster(ns) :
+                                                 nullptr);
+  auto neighbors = [&](int s, auto const& f) {
+    for (int k = 0; k < LATTICE::dimension; ++k) {
+      f(lattice.neighbor(s, k));
+      f(lattice.opposite_neighbor(s, k));
+    }
+  };
+  // calls f(s) for the sites in the cluster, which returns the change of satisfied bonds; in
+  // parallel for large clusters with -p
+  auto flip_cluster = [&](auto const& f) {
+    auto const& members = wolff->members();
+    int n = members.size();
+    std::vector<int> dsat(engines.size(), 0);
+    auto body = [&](int t, int nt) {
+      int d = 0;
+      for (int i = block(n, t, nt); i < block(n, t + 1, nt); ++i) d += f(members[i]);
+      dsat[t] = d;
+    };
+    if (p.parallel && n >= 1024) cluster::parallel::run(body); else body(0, 1);
+    return std::accumulate(dsat.begin(), dsat.end(), 0);
+  };
+  int wolff_nsat = p.wolff ? count_satisfied() : 0;
+  double wolff_mu = 0;
+  if (p.wolff) for (int s : spins) wolff_mu += 2 * s - 1;
 
   // observables
   standards::accumulator num_clusters("Number of Clusters"), energy("Energy Density"),
@@ -58,56 +175,182 @@ int main(int argc, char* argv[]) {
     magnetization4_unimp("Magnetization^4 (unimproved)"),
     magnetization2("Magnetization^2"), magnetization4("Magnetization^4");
 
-  standards::timer tm;
-  for (unsigned int mcs = 0; mcs < p.therm + p.sweeps; ++mcs) {
-    // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
-
-    // cluster generation
-    for (int b = 0; b < lattice.num_bonds(); ++b) {
-      if (spins[lattice.source(b)] == spins[lattice.target(b)] && r_uniform01(eng) < prob)
-        unify(fragments, lattice.source(b), lattice.target(b));
+  // the configuration after a step is measured with its energy, which is given by the number of
+  // satisfied bonds counted in the bond pass of the next step (or by count_satisfied() after the
+  // last one), instead of by a separate pass over bonds.  Unimproved magnetization is summed over
+  // clusters by their weight and spin after flip, instead of over sites.
+  struct sample {
+    bool measure;
+    int nc;
+    double mu, mag2, mag4; // unimproved magnetization, improved ones of its powers
+  };
+  sample last = { false, 0, 0, 0, 0 }; // not measured yet
+  auto record = [&](sample const& x, double ene) {
+    if (x.measure) {
+      num_clusters << (double)x.nc;
+      energy << ene / lattice.num_sites();
+      magnetization_unimp << x.mu;
+      magnetization2_unimp << power2(x.mu);
+      magnetization4_unimp << power4(x.mu);
+      magnetization2 << x.mag2;
+      magnetization4 << x.mag4;
     }
+  };
+  auto make_sample = [](bool measure, int nc, double mu, weight_moments<2, 4> const& m) {
+    return sample{ measure, nc, mu, m.sum<2>(), 3 * power2(m.sum<2>()) - 2 * m.sum<4>() };
+  };
+  auto energy_of = [&](int nsat) { return -(2.0 * nsat - nb); };
 
-    // assign cluster id & accumulate cluster properties
-    int nc = 0;
-    double mag2 = 0, mag4 = 0;
-    for (auto& f : fragments) {
-      if (f.is_root()) {
-        f.set_id(nc++);
-        double w = f.weight();
-        mag2 += power2(w);
-        mag4 += power4(w);
+  // Monte Carlo step with unify policy of type decltype(policy)
+  auto step = [&](auto policy, bool measure) {
+    typedef decltype(policy) policy_t;
+    int nc;
+    weight_moments<2, 4> m;
+    std::vector<int> nsat(engines.size(), 0); // satisfied bonds before flip per thread
+    std::vector<double> mu_thread(engines.size(), 0); // magnetization after flip per thread
+    if (p.wolff) {
+      // clusters are grown from random sites until ns spins are flipped in total, which makes an
+      // MCS-equivalent.  Each configuration before a flip is measured, since stopping after the
+      // last cluster depends on its size; cluster of size c gives improved estimators N c for M^2
+      // and 3 N c M^2 - 2 N c^3 for M^4.  Number of clusters is per MCS-equivalent.
+      std::vector<cluster::bernoulli> coins(engines.size(), activate);
+      nc = 0;
+      for (int flipped = 0; flipped < ns; ++nc) {
+        int s0 = ns * r_uniform01(0);
+        int sigma = spins[s0];
+        auto bond = [&](int, int t, int th) { return spins[t] == sigma && coins[th](engines[th]); };
+        double c = p.parallel ? wolff->grow_parallel(s0, neighbors, bond) :
+          wolff->grow(s0, neighbors, bond);
+        if (measure) {
+          energy << energy_of(wolff_nsat) / lattice.num_sites();
+          magnetization_unimp << wolff_mu;
+          magnetization2_unimp << power2(wolff_mu);
+          magnetization4_unimp << power4(wolff_mu);
+          magnetization2 << ns * c;
+          magnetization4 << 3 * ns * c * power2(wolff_mu) - 2 * ns * power2(c) * c;
+        }
+        wolff_nsat += flip_cluster([&](int s) {
+          int d = 0;
+          neighbors(s, [&](int t) { if (!wolff->contains(t)) d += (spins[t] == sigma) ? -1 : 1; });
+          spins[s] ^= 1;
+          return d;
+        });
+        wolff_mu -= 2 * (2 * sigma - 1) * c;
+        flipped += c;
       }
-    }
-    for (auto& f : fragments) f.set_id(cluster_id(fragments, f));
+      if (measure) num_clusters << (double)nc;
+      return;
+    } else if (p.multispin) {
+      // cluster generation, assign cluster id & flip spins by 64 sites
+      nc = multispin->step<policy_t>(prob, fragments, m, eng64);
+      record(make_sample(measure, nc, multispin->magnetization(), m), multispin->energy());
+      return;
+    } else if (!p.tile) {
+      // initialize cluster information
+      if (p.parallel)
+        reset_parallel(fragments);
+      else
+        reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
-    // flip spins
-    for (int c = 0; c < nc; ++c) flip[c] = (r_uniform01(eng) < 0.5);
-    for (int s = 0; s < lattice.num_sites(); ++s)
-      if (flip[fragments[s].id()]) spins[s] ^= 1;
+      // cluster generation
+      if (!p.run_length) {
+        run([&](int t, int nt) {
+          nsat[t] = for_each_active(t, nt, [&](int b) {
+            unify<policy_t>(fragments, lattice.source(b), lattice.target(b));
+          });
+        });
+      } else {
+        // runs of active bonds (s, s+1) are linked without find.  Each thread collects bonds
+        // whose sources are in its own range of sites; those reaching outside are unified last.
+        int z = LATTICE::dimension; // bonds per site
+        run([&](int t, int nt) {
+          run_collector<policy_t, fragments_t> runs(fragments, pending[t],
+            (block(nb, t, nt) + z - 1) / z, (block(nb, t + 1, nt) + z - 1) / z);
+          nsat[t] =
+            for_each_active(t, nt, [&](int b) { runs.add(lattice.source(b), lattice.target(b)); });
+          runs.flush();
+        });
+        run([&](int t, int) { unify_batch<policy_t>(fragments, pending[t]); });
+      }
+      update_weight<policy_t>(fragments); // no-op unless unify policy does not maintain weight
 
-    double ene = 0;
-    for (int b = 0; b < lattice.num_bonds(); ++b) {
-      ene -= (spins[lattice.source(b)] == spins[lattice.target(b)] ? 1.0 : -1.0);
-    }
-    double mu = 0;
-    for (int s = 0; s < lattice.num_sites(); ++s) mu += 2 * spins[s] - 1;
+      // assign cluster id, accumulate cluster properties & flip spins; spins are flipped after
+      // all the clusters are drawn, so that spins[r] of root r is still the one before flip
+      auto draw = [&](int c, int w, int r) {
+        int t = cluster::parallel::thread_num();
+        flip[c] = (r_uniform01(t) < 0.5);
+        mu_thread[t] += w * (2 * (spins[r] ^ flip[c]) - 1);
+      };
+      auto apply = [&](int s, int c) { if (flip[c]) spins[s] ^= 1; };
+      nc = p.parallel ? finalize_parallel(fragments, m, draw, apply) :
+        finalize(fragments, m, draw, apply);
+    } else {
+      // cluster generation & labeling by tiles
+      run([&](int t, int nt) {
+        std::fill(active.begin() + block(nb, t, nt), active.begin() + block(nb, t + 1, nt), 0);
+        nsat[t] = for_each_active(t, nt, [&](int b) { active[b] = 1; });
+      });
+      nc = labeler->label([&](int b) { return active[b] != 0; });
 
-    if (mcs >= p.therm) {
-      num_clusters << (double)nc;
-      energy << ene / lattice.num_sites();
-      magnetization_unimp << mu;
-      magnetization2_unimp << power2(mu);
-      magnetization4_unimp << power4(mu);
-      magnetization2 << mag2;
-      magnetization4 << (3 * power2(mag2) - 2 * mag4);
+      // accumulate cluster properties & flip spins
+      std::vector<weight_moments<2, 4> > m_thread(engines.size());
+      run([&](int t, int nt) {
+        for (int c = block(nc, t, nt); c < block(nc, t + 1, nt); ++c) {
+          m_thread[t].add(labeler->cluster_weight(c));
+          flip[c] = (r_uniform01(t) < 0.5);
+        }
+      });
+      for (auto const& mt : m_thread) m.merge(mt);
+      // no representative site of clusters in tiles; magnetization is summed while flipping
+      run([&](int t, int nt) {
+        double mu = 0;
+        for (int s = block(ns, t, nt); s < block(ns, t + 1, nt); ++s) {
+          if (flip[labeler->cluster_id(s)]) spins[s] ^= 1;
+          mu += 2 * spins[s] - 1;
+        }
+        mu_thread[t] = mu;
+      });
     }
+
+    // the previous step is measured with the energy counted in the bond pass (spins were not
+    // flipped yet), and this one is left for the next step
+    record(last, energy_of(std::accumulate(nsat.begin(), nsat.end(), 0)));
+    last = make_sample(measure, nc, std::accumulate(mu_thread.begin(), mu_thread.end(), 0.0), m);
+  };
+
+  // unify policy and number of threads, optionally chosen by timing extra steps (not measured)
+  cluster::autotune::config conf = { "default", cluster::parallel::max_threads() };
+  if (p.autotune) {
+    std::string key = "ising L=" + std::to_string(p.length) + " T=" +
+      std::to_string(p.temperature) + " tile=" + std::to_string(p.tile) +
+      (p.dim != 2 ? " d=" + std::to_string(p.dim) : "") + (p.helical ? " helical" : "") +
+      (p.order != site_order::row_major ? std::string(" ") + site_order_name(p.order) : "") +
+      (p.parallel ? " parallel" : "") + (p.run_length ? " run-length" : "") +
+      (p.threshold_bits ? " int=" + std::to_string(p.threshold_bits) : "") +
+      (p.skip ? " skip" : "") +
+      (p.multispin ? " multispin" : "");
+    // only thread-safe policies for parallel labeling
+    std::vector<std::string> policies = p.tile ? std::vector<std::string>{ "default" } :
+      cluster::autotune::policy_names(p.parallel);
+    conf = cluster::autotune::tuner(key).run([&](auto policy) { step(policy, false); }, policies);
+    cluster::parallel::set_num_threads(conf.threads);
   }
+  if (p.scaling)
+    cluster::autotune::strong_scaling([&](auto policy) { step(policy, false); }, conf.policy);
+
+  standards::timer tm;
+  cluster::autotune::dispatch(conf.policy, [&](auto policy) {
+    for (unsigned int mcs = 0; mcs < p.therm + p.sweeps; ++mcs) step(policy, mcs >= p.therm);
+  });
+  if (!p.multispin && !p.wolff) record(last, energy_of(count_satisfied()));
 
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
-            << "Speed = " << (p.therm + p.sweeps) / elapsed << " MCS/sec\n";
+            << "Speed = " << (p.therm + p.sweeps) / elapsed
+            << (p.wolff ? " MCS-equivalent/sec\n" : " MCS/sec\n");
+  if (p.parallel)
+    std::clog << "Threads = " << cluster::parallel::max_threads() << std::endl;
+  cluster::statistics::print(std::clog);
   std::cout << num_clusters << std::endl
             << energy << std::endl
             << magnetization_unimp << std::endl
@@ -118,3 +361,22 @@ int main(int argc, char* argv[]) {
             << "Binder Ratio of Magnetization = "
             << power2(magnetization2.mean()) / magnetization4.mean() << std::endl;
 }
+
+int main(int argc, char* argv[]) {
+  std::cout << "Swendsen-Wang Cluster Algorithm for Square Lattice Potts Model\n";
+  options p(argc, argv);
+  if (!p.valid) std::exit(127);
+
+  // hypercubic lattice, optionally with sites ordered along space-filling curve
+  dispatch_dimension(p.dim, [&](auto d) {
+    hypercubic<decltype(d)::value> lattice(p.length, p.helical ? boundary_type::helical :
+                                           boundary_type::periodic);
+    if (p.order == site_order::row_major) {
+      simulate(p, lattice);
+    } else {
+      ordered_hypercubic<decltype(d)::value> ordered(lattice, p.order);
+      print_locality(ordered, sizeof(cluster::union_find::node));
+      simulate(p, ordered);
+    }
+  });
+}
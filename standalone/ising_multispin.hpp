@@ -0,0 +1,181 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Multi-spin coded Swendsen-Wang step for Ising model on hypercubic lattice with periodic
+// boundary conditions
+//
+// Site index is s = x + L * r, where r is the index of the row along the x axis.  Spins of each
+// row are packed into words of 64 bits (bit x % 64 of word x / 64; the unused bits of the last
+// word are kept zero).  Satisfied bonds of 64 sites are given by XOR of the row and its neighbor
+// row (shifted by one bit for the x axis), and are ANDed with a word of Bernoulli(p) bits, so that
+// only the set bits are passed to unify.  Spins are flipped by XOR with a word of flip bits of
+// their clusters.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <cluster/finalize.hpp>
+#include <cluster/union_find.hpp>
+
+class ising_multispin {
+public:
+  typedef std::uint64_t word_type;
+  static const int word_bits = 64;
+
+  ising_multispin(int dim, int length) : dim_(dim), length_(length), num_rows_(1) {
+    for (int k = 1; k < dim; ++k) num_rows_ *= length;
+    words_per_row_ = (length + word_bits - 1) / word_bits;
+    int rest = length % word_bits;
+    last_mask_ = (rest == 0) ? ~word_type(0) : ((word_type(1) << rest) - 1);
+    spins_.resize(num_rows_ * words_per_row_);
+    for (int r = 0; r < num_rows_; ++r)
+      for (int w = 0; w < words_per_row_; ++w) spins_[r * words_per_row_ + w] = mask(w);
+    shifted_.resize(words_per_row_);
+    flip_.resize(num_sites());
+  }
+
+  int num_sites() const { return length_ * num_rows_; }
+  int num_bonds() const { return dim_ * num_sites(); }
+
+  // one Swendsen-Wang step with bond probability prob; fragments should have num_sites() nodes,
+  // and eng should generate 64-bit words (e.g. std::mt19937_64).  Returns number of clusters, and
+  // weight moments of clusters are added to m.
+  template<class POLICY, class FRAGMENTS, class M, class RNG>
+  int step(double prob, FRAGMENTS& fragments, M& m, RNG& eng) {
+    using namespace cluster::union_find;
+    bernoulli bond(prob);
+
+    // cluster generation
+    reset(fragments);
+    for (int r = 0; r < num_rows_; ++r) {
+      word_type const* row = &spins_[r * words_per_row_];
+      shift(row);
+      for (int w = 0; w < words_per_row_; ++w) {
+        int s = r * length_ + w * word_bits;
+        // x axis
+        for (word_type a = ~(row[w] ^ shifted_[w]) & mask(w) & bond(eng); a; a &= a - 1) {
+          int x = w * word_bits + trailing_zeros(a);
+          unify<POLICY>(fragments, r * length_ + x, r * length_ + ((x + 1 == length_) ? 0 : x + 1));
+        }
+        // other axes
+        for (int k = 1, stride = 1; k < dim_; ++k, stride *= length_) {
+          int rn = neighbor_row(r, stride);
+          word_type const* next = &spins_[rn * words_per_row_];
+          for (word_type a = ~(row[w] ^ next[w]) & mask(w) & bond(eng); a; a &= a - 1) {
+            int b = trailing_zeros(a);
+            unify<POLICY>(fragments, s + b, rn * length_ + w * word_bits + b);
+          }
+        }
+      }
+    }
+    update_weight<POLICY>(fragments); // no-op unless unify policy does not maintain weight
+
+    // assign cluster id, accumulate cluster properties & draw flips (64 per random word)
+    word_type bits = 0;
+    int nc = finalize(fragments, m, [&](int c, int) {
+      if (c % word_bits == 0) bits = eng();
+      flip_[c] = (bits >> (c % word_bits)) & 1;
+    });
+
+    // flip spins
+    for (int r = 0; r < num_rows_; ++r) {
+      for (int w = 0; w < words_per_row_; ++w) {
+        int s = r * length_ + w * word_bits;
+        int n = std::min(word_bits, length_ - w * word_bits);
+        word_type f = 0;
+        for (int b = 0; b < n; ++b) f |= word_type(flip_[fragments[s + b].id()]) << b;
+        spins_[r * words_per_row_ + w] ^= f;
+      }
+    }
+    return nc;
+  }
+
+  // energy = - (number of satisfied bonds) + (number of unsatisfied bonds)
+  double energy() {
+    long long sat = 0;
+    for (int r = 0; r < num_rows_; ++r) {
+      word_type const* row = &spins_[r * words_per_row_];
+      shift(row);
+      for (int w = 0; w < words_per_row_; ++w) {
+        sat += popcount(~(row[w] ^ shifted_[w]) & mask(w));
+        for (int k = 1, stride = 1; k < dim_; ++k, stride *= length_) {
+          word_type const* next = &spins_[neighbor_row(r, stride) * words_per_row_];
+          sat += popcount(~(row[w] ^ next[w]) & mask(w));
+        }
+      }
+    }
+    return -(2.0 * sat - num_bonds());
+  }
+
+  // sum of spins (+1 or -1)
+  double magnetization() const {
+    long long up = 0;
+    for (word_type a : spins_) up += popcount(a);
+    return 2.0 * up - num_sites();
+  }
+
+private:
+  // word of independent Bernoulli(p) bits with 53-bit precision.  Each bit compares p with a
+  // uniform random number generated bit by bit from the most significant one, and is decided
+  // at the first bit that differs; about 8 random words are consumed per call.
+  class bernoulli {
+  public:
+    explicit bernoulli(double p) {
+      threshold_ = (p >= 1) ? ~word_type(0) :
+        ((p <= 0) ? 0 : static_cast<word_type>(std::ldexp(p, 53)));
+    }
+    template<class RNG>
+    word_type operator()(RNG& eng) const {
+      if (threshold_ == ~word_type(0)) return ~word_type(0);
+      word_type undecided = ~word_type(0), result = 0;
+      for (int i = 52; i >= 0 && undecided; --i) {
+        word_type r = eng();
+        if ((threshold_ >> i) & 1) {
+          result |= undecided & ~r;
+          undecided &= r;
+        } else {
+          undecided &= ~r;
+        }
+      }
+      return result;
+    }
+  private:
+    word_type threshold_;
+  };
+
+  word_type mask(int w) const { return (w == words_per_row_ - 1) ? last_mask_ : ~word_type(0); }
+
+  // shifted_[x] = row[(x + 1) % L] in packed form
+  void shift(word_type const* row) {
+    for (int w = 0; w < words_per_row_; ++w)
+      shifted_[w] = (row[w] >> 1) | ((w + 1 < words_per_row_) ? (row[w + 1] << 63) : 0);
+    int last = length_ - 1;
+    word_type& tail = shifted_[last / word_bits];
+    tail = (tail & ~(word_type(1) << (last % word_bits))) | ((row[0] & 1) << (last % word_bits));
+  }
+
+  // row next to r along the axis whose index stride (in rows) is stride
+  int neighbor_row(int r, int stride) const {
+    return ((r / stride) % length_ == length_ - 1) ? r + stride - stride * length_ : r + stride;
+  }
+
+  static int trailing_zeros(word_type a) { return __builtin_ctzll(a); }
+  static int popcount(word_type a) { return __builtin_popcountll(a); }
+
+  int dim_, length_, num_rows_, words_per_row_;
+  word_type last_mask_;
+  std::vector<word_type> spins_;
+  std::vector<word_type> shifted_;
+  std::vector<char> flip_;
+};
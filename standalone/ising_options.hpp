@@ -11,16 +11,20 @@
 
 #include <cstdlib>
 #include <iostream>
+#include "site_order.hpp"
 
 struct options {
-  unsigned int seed, q, length;
+  unsigned int seed, q, dim, length;
   double temperature;
-  unsigned int sweeps, therm;
-  bool valid;
+  unsigned int sweeps, therm, tile, threshold_bits;
+  site_order order;
+  bool helical, run_length, skip, wolff, autotune, parallel, scaling, multispin, valid;
 
   options(unsigned int argc, char *argv[], bool print = true) :
     // default parameters
-    seed(29833), length(8), temperature(2.27), sweeps(1 << 16), therm(sweeps >> 3),
+    seed(29833), dim(2), length(8), temperature(2.27), sweeps(1 << 16), therm(sweeps >> 3),
+    tile(0), threshold_bits(0), order(site_order::row_major), helical(false), run_length(false),
+    skip(false), wolff(false), autotune(false), parallel(false), scaling(false), multispin(false),
     valid(true) {
     for (unsigned int i = 1; i < argc; ++i) {
       switch (argv[i][0]) {
@@ -29,6 +33,9 @@ struct options {
         case 's' :
           if (++i == argc) { usage(print); return; }
           seed = std::atoi(argv[i]); break;
+        case 'd' :
+          if (++i == argc) { usage(print); return; }
+          dim = std::atoi(argv[i]); break;
         case 'l' :
           if (++i == argc) { usage(print); return; }
           length = std::atoi(argv[i]); break;
@@ -39,6 +46,31 @@ struct options {
           if (++i == argc) { usage(print); return; }
           sweeps = std::atoi(argv[i]);
           therm = sweeps >> 3; break;
+        case 'b' :
+          if (++i == argc) { usage(print); return; }
+          tile = std::atoi(argv[i]); break;
+        case 'o' :
+          if (++i == argc || !parse_site_order(argv[i], order)) { usage(print); return; }
+          break;
+        case 'H' :
+          helical = true; break;
+        case 'r' :
+          run_length = true; break;
+        case 'i' :
+          if (++i == argc) { usage(print); return; }
+          threshold_bits = std::atoi(argv[i]); break;
+        case 'g' :
+          skip = true; break;
+        case 'c' :
+          wolff = true; break;
+        case 'a' :
+          autotune = true; break;
+        case 'p' :
+          parallel = true; break;
+        case 'S' :
+          scaling = true; break;
+        case 'w' :
+          multispin = true; break;
         case 'h' :
           usage(print, std::cout); return;
         default :
@@ -49,7 +81,11 @@ struct options {
         usage(print); return;
       }
     }
-    if (length == 0 || temperature <= 0. || sweeps == 0) {
+    if (dim == 0 || dim > max_dimension || length == 0 || temperature <= 0. || sweeps == 0 ||
+        (run_length && tile) || threshold_bits > 64 || (skip && threshold_bits) ||
+        (wolff && (tile || run_length || skip || autotune)) ||
+        (multispin && (tile || parallel || run_length || threshold_bits || skip || wolff ||
+                       helical || order != site_order::row_major))) {
       std::cerr << "invalid parameter(s)\n"; usage(print); return;
     }
     if (print) {
@@ -58,15 +94,49 @@ struct options {
                 << "Temperature            = " << temperature << std::endl
                 << "MCS for Thermalization = " << therm << std::endl
                 << "MCS for Measurement    = " << sweeps << std::endl;
+      if (dim != 2)
+        std::cout << "Dimension              = " << dim << std::endl;
+      if (order != site_order::row_major)
+        std::cout << "Site Ordering          = " << site_order_name(order) << std::endl;
+      if (helical)
+        std::cout << "Boundary Conditions    = helical" << std::endl;
+      if (tile)
+        std::cout << "Tile Size              = " << tile << std::endl;
+      if (run_length)
+        std::cout << "Run-Length Collapsing  = on" << std::endl;
+      if (threshold_bits)
+        std::cout << "Integer Threshold      = " << threshold_bits << " bits" << std::endl;
+      if (skip)
+        std::cout << "Geometric Skipping     = on" << std::endl;
+      if (wolff)
+        std::cout << "Single-Cluster Update  = on" << std::endl;
+      if (autotune)
+        std::cout << "Autotune               = on" << std::endl;
+      if (parallel)
+        std::cout << "Parallel Sweep         = on" << std::endl;
+      if (multispin)
+        std::cout << "Multi-Spin Coding      = on" << std::endl;
     }
   }
   void usage(bool print, std::ostream& os = std::cerr) {
     if (print)
       os << "[command line options]\n"
          << "  -s int    Seed of RNG\n"
+         << "  -d int    Dimension of hypercubic lattice (1-4)\n"
          << "  -l int    System Linear Size\n"
          << "  -t double Temperature\n"
          << "  -m int    MCS for Measurement\n"
+         << "  -b int    Tile Size for two-level cluster labeling (0 for off)\n"
+         << "  -o name   Site ordering (row-major, morton or hilbert)\n"
+         << "  -H        Helical boundary conditions (periodic otherwise)\n"
+         << "  -r        Run-length collapsing of active bonds (not with -b)\n"
+         << "  -i int    Bits per trial by integer threshold (1-64; 0 for double uniform)\n"
+         << "  -g        Geometric skipping of inactive satisfied bonds (not with -i)\n"
+         << "  -c        Single-cluster (Wolff) update (not with -b, -r, -g, -a or -w)\n"
+         << "  -a        Autotune unify policy and number of threads\n"
+         << "  -p        Parallel sweep with per-thread RNG streams\n"
+         << "  -S        Report strong scaling before the run\n"
+         << "  -w        Multi-spin coding (64 spins/word; not with -b, -p, -r, -i, -g, -o or -H)\n"
          << "  -h        this help\n";
     valid = false;
   }
@@ -23,6 +23,7 @@
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
+#include <cluster/huge_page_allocator.hpp>
 #include <cluster/union_find.hpp>
 #include "loop_options.hpp"
 
@@ -48,6 +49,7 @@ struct cluster_t {
 };
 
 typedef cluster::union_find::node fragment_t;
+typedef cluster::huge_page_allocator<fragment_t> allocator_t;
 
 // lattice helper functions (returns site index at left/right end of a bond)
 inline int left(int /* L */, int b) { return b; }
@@ -76,7 +78,7 @@ int main(int argc, char* argv[]) {
   std::vector<int> spins(nsites, 0); // initialized with all up
 
   // cluster information
-  std::vector<fragment_t> fragments;
+  std::vector<fragment_t, allocator_t> fragments;
   std::vector<unsigned int> current(nsites); // id of fragments at current time
   std::vector<cluster_t> clusters;
 
@@ -144,10 +146,8 @@ int main(int argc, char* argv[]) {
     //
 
     // assign cluster id & determine if clusters are to be flipped
-    int nc = 0;
-    for (auto& f : fragments) { if (f.is_root()) f.set_id(nc++); }
+    int nc = assign_id(fragments);
     clusters.resize(nc);
-    for (auto& f : fragments) { f.set_id(cluster_id(fragments, f)); }
     for (int c = 0; c < nc; ++c) clusters[c] = cluster_t(r_uniform01(eng) < 0.5);
 
     // 'flip' operators & do improved measurements
@@ -196,6 +196,7 @@ int main(int argc, char* argv[]) {
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
             << "Speed = " << (therm + sweeps) / elapsed << " MCS/sec\n";
+  cluster::statistics::print(std::clog);
   std::cout << energy << std::endl
             << smag<< std::endl
             << usus << std::endl
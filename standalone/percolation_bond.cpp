@@ -9,75 +9,179 @@
 *
 *****************************************************************************/
 
-// Bond Percolation Problem on Square Lattice
+// Bond Percolation Problem on Hypercubic Lattice
 
 #ifndef ALPS_INDEP_SOURCE
 # define ALPS_INDEP_SOURCE
 #endif
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <random>
+#include <string>
+#include <utility>
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
-#include <lattice/graph.hpp>
+#include <cluster/autotune.hpp>
+#include <cluster/bernoulli.hpp>
+#include <cluster/geometric_skip.hpp>
+#include <cluster/huge_page_allocator.hpp>
+#include <cluster/run_length.hpp>
+#include <cluster/tiled_labeler.hpp>
 #include <cluster/union_find.hpp>
+#include "site_order.hpp"
 #include "percolation_options.hpp"
 
 using standards::power2;
+using cluster::union_find::run_collector;
+using cluster::union_find::unify_batch;
+using cluster::union_find::update_weight;
 
-int main(int argc, char* argv[]) {
-  std::cout << "Bond Percolation Problem on Square Lattice\n";
-  options p(argc, argv, 0.5);
-  if (!p.valid) std::exit(127);
+template<class LATTICE>
+void simulate(options const& p, LATTICE const& lattice) {
 
-  // square lattice
-  auto lattice = lattice::graph::simple(2, p.length);
-
-  // random number generators
+  // random number generators; bond occupation by integer threshold with -i (see
+  // cluster/bernoulli.hpp)
   std::mt19937 eng(p.seed);
-  std::uniform_real_distribution<> r_uniform01;
+  cluster::bernoulli occupy(p.probability, p.threshold_bits);
+  if (p.threshold_bits)
+    std::clog << "Effective Occupation Probability = " << occupy.probability() << " (error "
+              << occupy.probability() - p.probability << ")\n";
+
+  // calls f(i) for the occupied bonds i in [0, n) in increasing order, by a trial per bond, or by
+  // geometric skipping with -g (see cluster/geometric_skip.hpp)
+  auto for_each_occupied = [&](int n, auto const& f) {
+    if (!p.skip) {
+      cluster::bernoulli coin = occupy;
+      for (int i = 0; i < n; ++i)
+        if (coin(eng)) f(i);
+    } else {
+      cluster::geometric_skip(p.probability).for_each_success(n, eng,
+        [&](std::uint64_t i) { f(static_cast<int>(i)); });
+    }
+  };
 
   // cluster information
   typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
+  typedef cluster::huge_page_allocator<fragment_t> allocator_t;
+  typedef cluster::union_find::node_array<allocator_t> fragments_t;
+  fragments_t fragments(p.tile ? 0 : lattice.num_sites());
+  std::vector<std::pair<int, int> > pairs; // pairs of sites to be unified
+
+  // two-level cluster labeling (optional)
+  typedef cluster::union_find::tiled_labeler<fragment_t, allocator_t> labeler_t;
+  std::unique_ptr<labeler_t> labeler(p.tile ? new labeler_t(lattice, p.tile) : nullptr);
+  std::vector<char> active(p.tile ? lattice.num_bonds() : 0);
 
   // observables
   standards::accumulator num_clusters("Number of Clusters"), strength("Strength of Largest Cluster"),
     cluster_size("Cluster Size");
 
-  standards::timer tm;
-  for (unsigned int mcs = 0; mcs < p.sweeps; ++mcs) {
-    // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
-
-    // cluster generation
-    for (int b = 0; b < lattice.num_bonds(); ++b)
-      if (r_uniform01(eng) < p.probability) unify(fragments, lattice.source(b), lattice.target(b));
-
-    // accumulate cluster properties
+  // Monte Carlo step with unify policy of type decltype(policy)
+  auto step = [&](auto policy, bool measure) {
+    typedef decltype(policy) policy_t;
     int nc = 0;
     double wmax = 0, mag2 = 0;
-    for (auto& f : fragments) {
-      if (f.is_root()) {
-        ++nc;
-        double w = f.weight();
+    if (!p.tile) {
+      // initialize cluster information
+      reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
+
+      // cluster generation; with run-length collapsing, runs of active bonds (s, s+1) are linked
+      // without find, and only the other bonds are unified
+      if (!p.run_length) {
+        pairs.clear();
+        for_each_occupied(lattice.num_bonds(), [&](int b) {
+          pairs.push_back(std::make_pair(lattice.source(b), lattice.target(b)));
+        });
+      } else {
+        run_collector<policy_t, fragments_t> runs(fragments, pairs, 0, lattice.num_sites());
+        for_each_occupied(lattice.num_bonds(),
+                          [&](int b) { runs.add(lattice.source(b), lattice.target(b)); });
+        runs.flush();
+      }
+      unify_batch<policy_t>(fragments, pairs);
+      update_weight<policy_t>(fragments); // no-op unless unify policy does not maintain weight
+
+      // accumulate cluster properties
+      for (int s = 0; s < lattice.num_sites(); ++s) {
+        if (fragments[s].is_root()) {
+          ++nc;
+          double w = fragments[s].weight();
+          wmax = std::max(wmax, w);
+          mag2 += power2(w);
+        }
+      }
+    } else {
+      // cluster generation & labeling by tiles
+      std::fill(active.begin(), active.end(), 0);
+      for_each_occupied(lattice.num_bonds(), [&](int b) { active[b] = 1; });
+      nc = labeler->label([&](int b) { return active[b] != 0; });
+
+      // accumulate cluster properties
+      for (int c = 0; c < nc; ++c) {
+        double w = labeler->cluster_weight(c);
         wmax = std::max(wmax, w);
         mag2 += power2(w);
       }
     }
 
-    num_clusters << (double)nc;
-    strength << wmax / lattice.num_sites();
-    cluster_size << (mag2 - power2(wmax)) / lattice.num_sites();
+    if (measure) {
+      num_clusters << (double)nc;
+      strength << wmax / lattice.num_sites();
+      cluster_size << (mag2 - power2(wmax)) / lattice.num_sites();
+    }
+  };
+
+  // unify policy and number of threads, optionally chosen by timing extra steps (not measured)
+  cluster::autotune::config conf = { "default", cluster::parallel::max_threads() };
+  if (p.autotune) {
+    std::string key = "percolation_bond L=" + std::to_string(p.length) + " p=" +
+      std::to_string(p.probability) + " tile=" + std::to_string(p.tile) +
+      (p.dim != 2 ? " d=" + std::to_string(p.dim) : "") + (p.helical ? " helical" : "") +
+      (p.order != site_order::row_major ? std::string(" ") + site_order_name(p.order) : "") +
+      (p.run_length ? " run-length" : "") +
+      (p.threshold_bits ? " int=" + std::to_string(p.threshold_bits) : "") +
+      (p.skip ? " skip" : "");
+    std::vector<std::string> policies =
+      p.tile ? std::vector<std::string>{ "default" } : cluster::autotune::policy_names();
+    conf = cluster::autotune::tuner(key).run([&](auto policy) { step(policy, false); }, policies);
+    cluster::parallel::set_num_threads(conf.threads);
   }
 
+  standards::timer tm;
+  cluster::autotune::dispatch(conf.policy, [&](auto policy) {
+    for (unsigned int mcs = 0; mcs < p.sweeps; ++mcs) step(policy, true);
+  });
+
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
             << "Speed = " << p.sweeps / elapsed << " MCS/sec\n";
+  cluster::statistics::print(std::clog);
   std::cout << num_clusters << std::endl
             << strength << std::endl
             << cluster_size << std::endl;
 }
+
+int main(int argc, char* argv[]) {
+  std::cout << "Bond Percolation Problem on Square Lattice\n";
+  options p(argc, argv, 0.5);
+  if (!p.valid) std::exit(127);
+
+  // hypercubic lattice, optionally with sites ordered along space-filling curve
+  dispatch_dimension(p.dim, [&](auto d) {
+    hypercubic<decltype(d)::value> lattice(p.length, p.helical ? boundary_type::helical :
+                                           boundary_type::periodic);
+    if (p.order == site_order::row_major) {
+      simulate(p, lattice);
+    } else {
+      ordered_hypercubic<decltype(d)::value> ordered(lattice, p.order);
+      print_locality(ordered, sizeof(cluster::union_find::node));
+      simulate(p, ordered);
+    }
+  });
+}
@@ -11,16 +11,19 @@
 
 #include <cstdlib>
 #include <iostream>
+#include "site_order.hpp"
 
 struct options {
-  unsigned int seed, length;
+  unsigned int seed, dim, length;
   double probability;
-  unsigned int sweeps;
-  bool valid;
+  unsigned int sweeps, tile, threshold_bits;
+  site_order order;
+  bool helical, run_length, skip, autotune, valid;
 
   options(unsigned int argc, char *argv[], double default_probability, bool print = true) :
-    seed(29833), length(256), probability(default_probability), sweeps(1 << 8),
-    valid(true) {
+    seed(29833), dim(2), length(256), probability(default_probability), sweeps(1 << 8), tile(0),
+    threshold_bits(0), order(site_order::row_major), helical(false), run_length(false), skip(false),
+    autotune(false), valid(true) {
     for (unsigned int i = 1; i < argc; ++i) {
       switch (argv[i][0]) {
       case '-' :
@@ -28,6 +31,9 @@ struct options {
         case 's' :
           if (++i == argc) { usage(print); return; }
           seed = std::atoi(argv[i]); break;
+        case 'd' :
+          if (++i == argc) { usage(print); return; }
+          dim = std::atoi(argv[i]); break;
         case 'l' :
           if (++i == argc) { usage(print); return; }
           length = std::atoi(argv[i]); break;
@@ -37,6 +43,23 @@ struct options {
         case 'm' :
           if (++i == argc) { usage(print); return; }
           sweeps = std::atoi(argv[i]); break;
+        case 'b' :
+          if (++i == argc) { usage(print); return; }
+          tile = std::atoi(argv[i]); break;
+        case 'o' :
+          if (++i == argc || !parse_site_order(argv[i], order)) { usage(print); return; }
+          break;
+        case 'H' :
+          helical = true; break;
+        case 'r' :
+          run_length = true; break;
+        case 'i' :
+          if (++i == argc) { usage(print); return; }
+          threshold_bits = std::atoi(argv[i]); break;
+        case 'g' :
+          skip = true; break;
+        case 'a' :
+          autotune = true; break;
         case 'h' :
           usage(print, std::cout); return;
         default :
@@ -47,7 +70,8 @@ struct options {
         usage(print); return;
       }
     }
-    if (length == 0 || probability < 0 || probability > 1 || sweeps == 0) {
+    if (dim == 0 || dim > max_dimension || length == 0 || probability < 0 || probability > 1 ||
+        sweeps == 0 || (run_length && tile) || threshold_bits > 64 || (skip && threshold_bits)) {
       std::cerr << "invalid parameter(s)\n"; usage(print); return;
     }
     if (print) {
@@ -55,15 +79,39 @@ struct options {
                 << "System Linear Size     = " << length << std::endl
                 << "Occupation Probability = " << probability << std::endl
                 << "Monte Carlo Steps      = " << sweeps << std::endl;;
+      if (dim != 2)
+        std::cout << "Dimension              = " << dim << std::endl;
+      if (order != site_order::row_major)
+        std::cout << "Site Ordering          = " << site_order_name(order) << std::endl;
+      if (helical)
+        std::cout << "Boundary Conditions    = helical" << std::endl;
+      if (tile)
+        std::cout << "Tile Size              = " << tile << std::endl;
+      if (run_length)
+        std::cout << "Run-Length Collapsing  = on" << std::endl;
+      if (threshold_bits)
+        std::cout << "Integer Threshold      = " << threshold_bits << " bits" << std::endl;
+      if (skip)
+        std::cout << "Geometric Skipping     = on" << std::endl;
+      if (autotune)
+        std::cout << "Autotune               = on" << std::endl;
     }
   }
   void usage(bool print, std::ostream& os = std::cerr) {
     if (print)
       os << "[command line options]\n"
          << "  -s int    Seed of RNG\n"
+         << "  -d int    Dimension of hypercubic lattice (1-4)\n"
          << "  -l int    System Linear Size\n"
          << "  -p double Occupation Probability\n"
          << "  -m int    Monte Carlo Steps\n"
+         << "  -b int    Tile Size for two-level cluster labeling (0 for off)\n"
+         << "  -o name   Site ordering (row-major, morton or hilbert)\n"
+         << "  -H        Helical boundary conditions (periodic otherwise)\n"
+         << "  -r        Run-length collapsing of active bonds (not with -b)\n"
+         << "  -i int    Bits per trial by integer threshold (1-64; 0 for double uniform)\n"
+         << "  -g        Geometric skipping of inactive bonds or sites (not with -i)\n"
+         << "  -a        Autotune unify policy and number of threads\n"
          << "  -h        this help\n";
     valid = false;
   }
@@ -9,82 +9,191 @@
 *
 *****************************************************************************/
 
-// Site Percolation Problem on Square Lattice
+// Site Percolation Problem on Hypercubic Lattice
 
 #ifndef ALPS_INDEP_SOURCE
 # define ALPS_INDEP_SOURCE
 #endif
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
+#include <utility>
 #include <vector>
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
-#include <lattice/graph.hpp>
+#include <cluster/autotune.hpp>
+#include <cluster/bernoulli.hpp>
+#include <cluster/geometric_skip.hpp>
+#include <cluster/huge_page_allocator.hpp>
+#include <cluster/run_length.hpp>
+#include <cluster/tiled_labeler.hpp>
 #include <cluster/union_find.hpp>
+#include "site_order.hpp"
 #include "percolation_options.hpp"
 
 using standards::power2;
+using cluster::union_find::run_collector;
+using cluster::union_find::unify;
+using cluster::union_find::update_weight;
 
-int main(int argc, char* argv[]) {
-  std::cout << "Site Percolation Problem on Square Lattice\n";
-  options p(argc, argv, 0.592746);
-  if (!p.valid) std::exit(127);
+template<class LATTICE>
+void simulate(options const& p, LATTICE const& lattice) {
 
-  // square lattice
-  auto lattice = lattice::graph::simple(2, p.length);
-
-  // random number generators
+  // random number generators; site occupation by integer threshold with -i (see
+  // cluster/bernoulli.hpp)
   std::mt19937 eng(p.seed);
-  std::uniform_real_distribution<> r_uniform01;
+  cluster::bernoulli occupy(p.probability, p.threshold_bits);
+  if (p.threshold_bits)
+    std::clog << "Effective Occupation Probability = " << occupy.probability() << " (error "
+              << occupy.probability() - p.probability << ")\n";
+
+  // calls f(i) for the occupied sites i in [0, n) in increasing order, by a trial per site, or by
+  // geometric skipping with -g (see cluster/geometric_skip.hpp)
+  auto for_each_occupied = [&](int n, auto const& f) {
+    if (!p.skip) {
+      cluster::bernoulli coin = occupy;
+      for (int i = 0; i < n; ++i)
+        if (coin(eng)) f(i);
+    } else {
+      cluster::geometric_skip(p.probability).for_each_success(n, eng,
+        [&](std::uint64_t i) { f(static_cast<int>(i)); });
+    }
+  };
+
+  int nb = lattice.num_bonds();
+  int ns = lattice.num_sites();
 
   // configuration
-  std::vector<bool> occupied(lattice.num_sites());
+  std::vector<bool> occupied(ns);
 
   // cluster information
   typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
+  typedef cluster::huge_page_allocator<fragment_t> allocator_t;
+  typedef cluster::union_find::node_array<allocator_t> fragments_t;
+  fragments_t fragments(p.tile ? 0 : lattice.num_sites());
+  std::vector<std::pair<int, int> > pairs; // for run-length collapsing
+
+  // two-level cluster labeling (optional)
+  typedef cluster::union_find::tiled_labeler<fragment_t, allocator_t> labeler_t;
+  std::unique_ptr<labeler_t> labeler(p.tile ? new labeler_t(lattice, p.tile) : nullptr);
 
   // observables
   standards::accumulator num_clusters("Number of Clusters"), strength("Strength of Largest Cluster"),
     cluster_size("Cluster Size");
 
-  standards::timer tm;
-  for (unsigned int mcs = 0; mcs < p.sweeps; ++mcs) {
-    // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
-
-    // cluster generation
-    for (int s = 0; s < lattice.num_sites(); ++s) occupied[s] = (r_uniform01(eng) < p.probability);
-    for (int b = 0; b < lattice.num_bonds(); ++b) {
-      int s0 = lattice.source(b);
-      int s1 = lattice.target(b);
-      if (occupied[s0] && occupied[s1]) unify(fragments, s0, s1);
-    }
+  // Monte Carlo step with unify policy of type decltype(policy)
+  auto step = [&](auto policy, bool measure) {
+    typedef decltype(policy) policy_t;
+    // site configuration
+    std::fill(occupied.begin(), occupied.end(), false);
+    for_each_occupied(lattice.num_sites(), [&](int s) { occupied[s] = true; });
 
-    // accumulate cluster properties
     int nc = 0;
     double wmax = 0, mag2 = 0;
-    for (auto& f : fragments) {
-      if (f.is_root()) {
-        ++nc;
-        double w = f.weight();
+    if (!p.tile) {
+      // initialize cluster information
+      reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
+
+      // cluster generation; with run-length collapsing, runs of active bonds (s, s+1) are linked
+      // without find, and only the other bonds are unified
+      if (!p.run_length) {
+        for (int b = 0; b < nb; ++b) {
+          int s0 = lattice.source(b);
+          int s1 = lattice.target(b);
+          if (occupied[s0] && occupied[s1]) unify<policy_t>(fragments, s0, s1);
+        }
+      } else {
+        run_collector<policy_t, fragments_t> runs(fragments, pairs, 0, lattice.num_sites());
+        for (int b = 0; b < nb; ++b) {
+          int s0 = lattice.source(b);
+          int s1 = lattice.target(b);
+          if (occupied[s0] && occupied[s1]) runs.add(s0, s1);
+        }
+        runs.flush(); // no bond is left in pairs for the whole range of sites
+      }
+      update_weight<policy_t>(fragments); // no-op unless unify policy does not maintain weight
+
+      // accumulate cluster properties
+      for (int s = 0; s < ns; ++s) {
+        if (fragments[s].is_root()) {
+          ++nc;
+          double w = fragments[s].weight();
+          wmax = std::max(wmax, w);
+          mag2 += power2(w);
+        }
+      }
+    } else {
+      // cluster generation & labeling by tiles
+      nc = labeler->label([&](int b) {
+        return occupied[lattice.source(b)] && occupied[lattice.target(b)];
+      });
+
+      // accumulate cluster properties
+      for (int c = 0; c < nc; ++c) {
+        double w = labeler->cluster_weight(c);
         wmax = std::max(wmax, w);
         mag2 += power2(w);
       }
     }
 
-    num_clusters << (double)nc;
-    strength << wmax / lattice.num_sites();
-    cluster_size << (mag2 - power2(wmax)) / lattice.num_sites();
+    if (measure) {
+      num_clusters << (double)nc;
+      strength << wmax / lattice.num_sites();
+      cluster_size << (mag2 - power2(wmax)) / lattice.num_sites();
+    }
+  };
+
+  // unify policy and number of threads, optionally chosen by timing extra steps (not measured)
+  cluster::autotune::config conf = { "default", cluster::parallel::max_threads() };
+  if (p.autotune) {
+    std::string key = "percolation_site L=" + std::to_string(p.length) + " p=" +
+      std::to_string(p.probability) + " tile=" + std::to_string(p.tile) +
+      (p.dim != 2 ? " d=" + std::to_string(p.dim) : "") + (p.helical ? " helical" : "") +
+      (p.order != site_order::row_major ? std::string(" ") + site_order_name(p.order) : "") +
+      (p.run_length ? " run-length" : "") +
+      (p.threshold_bits ? " int=" + std::to_string(p.threshold_bits) : "") +
+      (p.skip ? " skip" : "");
+    std::vector<std::string> policies =
+      p.tile ? std::vector<std::string>{ "default" } : cluster::autotune::policy_names();
+    conf = cluster::autotune::tuner(key).run([&](auto policy) { step(policy, false); }, policies);
+    cluster::parallel::set_num_threads(conf.threads);
   }
 
+  standards::timer tm;
+  cluster::autotune::dispatch(conf.policy, [&](auto policy) {
+    for (unsigned int mcs = 0; mcs < p.sweeps; ++mcs) step(policy, true);
+  });
+
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
             << "Speed = " << p.sweeps / elapsed << " MCS/sec\n";
+  cluster::statistics::print(std::clog);
   std::cout << num_clusters << std::endl
             << strength << std::endl
             << cluster_size << std::endl;
 }
+
+int main(int argc, char* argv[]) {
+  std::cout << "Site Percolation Problem on Square Lattice\n";
+  options p(argc, argv, 0.592746);
+  if (!p.valid) std::exit(127);
+
+  // hypercubic lattice, optionally with sites ordered along space-filling curve
+  dispatch_dimension(p.dim, [&](auto d) {
+    hypercubic<decltype(d)::value> lattice(p.length, p.helical ? boundary_type::helical :
+                                           boundary_type::periodic);
+    if (p.order == site_order::row_major) {
+      simulate(p, lattice);
+    } else {
+      ordered_hypercubic<decltype(d)::value> ordered(lattice, p.order);
+      print_locality(ordered, sizeof(cluster::union_find::node));
+      simulate(p, ordered);
+    }
+  });
+}
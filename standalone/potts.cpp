@@ -9,7 +9,7 @@
 *
 *****************************************************************************/
 
-// Swendsen-Wang Cluster Algorithm for Square-Lattice Potts Model
+// Swendsen-Wang Cluster Algorithm for Hypercubic-Lattice Potts Model
 
 #ifndef ALPS_INDEP_SOURCE
 # define ALPS_INDEP_SOURCE
@@ -17,91 +17,333 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <random>
+#include <string>
+#include <utility>
 #include <vector>
 #include <standards/accumulator.hpp>
 #include <standards/power.hpp>
 #include <standards/timer.hpp>
-#include <lattice/graph.hpp>
+#include <cluster/autotune.hpp>
+#include <cluster/bernoulli.hpp>
+#include <cluster/finalize.hpp>
+#include <cluster/geometric_skip.hpp>
+#include <cluster/huge_page_allocator.hpp>
+#include <cluster/potts_spin.hpp>
+#include <cluster/run_length.hpp>
+#include <cluster/single_cluster.hpp>
+#include <cluster/tiled_labeler.hpp>
 #include <cluster/union_find.hpp>
+#include "site_order.hpp"
 #include "potts_options.hpp"
 
 using standards::power2;
-using standards::power4;
+using cluster::union_find::run_collector;
+using cluster::union_find::unify;
+using cluster::union_find::unify_batch;
+using cluster::union_find::update_weight;
+using cluster::union_find::weight_moments;
+using cluster::potts::spin_type;
 
-int main(int argc, char* argv[]) {
-  std::cout << "Swendsen-Wang Cluster Algorithm for Square Lattice Potts Model\n";
-  options p(argc, argv);
-  if (!p.valid) std::exit(127);
+template<class LATTICE>
+void simulate(options const& p, LATTICE const& lattice) {
   unsigned int q = p.q;
   double prob = 1 - std::exp(-1 / p.temperature);
 
-  // square lattice
-  auto lattice = lattice::graph::simple(2, p.length);
+  // random number generators; one stream per thread in parallel sweep
+  std::vector<std::mt19937> engines;
+  if (p.parallel) {
+    for (int t = 0; t < cluster::parallel::max_threads(); ++t) {
+      std::seed_seq seq{ p.seed, static_cast<unsigned int>(t) };
+      engines.emplace_back(seq);
+    }
+  } else {
+    engines.emplace_back(p.seed);
+  }
+  auto r_uniform01 = [&](int t) { return std::uniform_real_distribution<>()(engines[t]); };
+
+  // bond activation by integer threshold with -i (see cluster/bernoulli.hpp); copied by each
+  // thread in every sweep, since it buffers engine output
+  cluster::bernoulli activate(prob, p.threshold_bits);
+  if (p.threshold_bits)
+    std::clog << "Effective Bond Probability = " << activate.probability() << " (error "
+              << activate.probability() - prob << ")\n";
 
-  // random number generators
-  std::mt19937 eng(p.seed);
-  std::uniform_real_distribution<> r_uniform01;
+  // f(t, nt) is called by all the threads in parallel sweep, or as f(0, 1) otherwise.  Bonds,
+  // sites and clusters are divided into contiguous blocks, one per thread.
+  auto run = [&](auto const& f) { if (p.parallel) cluster::parallel::run(f); else f(0, 1); };
+  auto block = [](int n, int t, int nt) { return cluster::parallel::block_begin(0, n, t, nt); };
+  int nb = lattice.num_bonds();
+  int ns = lattice.num_sites();
 
   // spin configuration
-  std::vector<int> spins(lattice.num_sites(), 0 /* all zero state */);
+  std::vector<spin_type> spins(lattice.num_sites(), 0 /* all zero state */);
 
   // cluster information
   typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
-  std::vector<int> flip(lattice.num_sites());
+  typedef cluster::huge_page_allocator<fragment_t> allocator_t;
+  typedef cluster::union_find::node_array<allocator_t> fragments_t;
+  fragments_t fragments(p.tile ? 0 : lattice.num_sites());
+  std::vector<spin_type> flip(lattice.num_sites());
+
+  // two-level cluster labeling (optional)
+  typedef cluster::union_find::tiled_labeler<fragment_t, allocator_t> labeler_t;
+  std::unique_ptr<labeler_t> labeler(p.tile ? new labeler_t(lattice, p.tile) : nullptr);
+  std::vector<char> active(p.tile ? lattice.num_bonds() : 0);
+
+  // active bonds not in runs, per thread (run-length collapsing)
+  std::vector<std::vector<std::pair<int, int> > > pending(engines.size());
+
+  // satisfied bonds, compacted in the block of each thread (geometric skipping)
+  std::vector<int> satisfied(p.skip ? nb : 0);
+
+  // calls f(b) for the active bonds in block t in increasing order, and returns the number of
+  // satisfied bonds in the block.  With -g, satisfied bonds are first compacted without branch,
+  // and then active ones are picked by geometric skipping (see cluster/geometric_skip.hpp), which
+  // draws a random number per active bond instead of per satisfied one.
+  auto for_each_active = [&](int t, int nt, auto const& f) {
+    int first = block(nb, t, nt), last = block(nb, t + 1, nt);
+    int n = 0;
+    if (!p.skip) {
+      cluster::bernoulli coin = activate;
+      for (int b = first; b < last; ++b) {
+        bool sat = (spins[lattice.source(b)] == spins[lattice.target(b)]);
+        n += sat;
+        if (sat && coin(engines[t])) f(b);
+      }
+    } else {
+      for (int b = first; b < last; ++b) {
+        satisfied[first + n] = b;
+        n += (spins[lattice.source(b)] == spins[lattice.target(b)]);
+      }
+      cluster::geometric_skip(prob).for_each_success(n, engines[t],
+        [&](std::uint64_t i) { f(satisfied[first + i]); });
+    }
+    return n;
+  };
+
+  // number of satisfied bonds without cluster generation
+  auto count_satisfied = [&]() {
+    std::vector<int> nsat(engines.size(), 0);
+    run([&](int t, int nt) {
+      int n = 0;
+      for (int b = block(nb, t, nt); b < block(nb, t + 1, nt); ++b)
+        n += (spins[lattice.source(b)] == spins[lattice.target(b)]);
+      nsat[t] = n;
+    });
+    return std::accumulate(nsat.begin(), nsat.end(), 0);
+  };
+
+  // single-cluster update (-c); spins of the cluster are shifted after it is grown, and the
+  // number of satisfied bonds and the number of sites in each state are updated from the cluster
+  // and the bonds on its boundary
+  std::unique_ptr<cluster::single_cluster> wolff(p.wolff ? new cluster::single_cluster(ns) :
+                                                 nullptr);
+  auto neighbors = [&](int s, auto const& f) {
+    for (int k = 0; k < LATTICE::dimension; ++k) {
+      f(lattice.neighbor(s, k));
+      f(lattice.opposite_neighbor(s, k));
+    }
+  };
+  // calls f(s) for the sites in the cluster, which returns the change of satisfied bonds; in
+  // parallel for large clusters with -p
+  auto flip_cluster = [&](auto const& f) {
+    auto const& members = wolff->members();
+    int n = members.size();
+    std::vector<int> dsat(engines.size(), 0);
+    auto body = [&](int t, int nt) {
+      int d = 0;
+      for (int i = block(n, t, nt); i < block(n, t + 1, nt); ++i) d += f(members[i]);
+      dsat[t] = d;
+    };
+    if (p.parallel && n >= 1024) cluster::parallel::run(body); else body(0, 1);
+    return std::accumulate(dsat.begin(), dsat.end(), 0);
+  };
+  int wolff_nsat = p.wolff ? count_satisfied() : 0;
+  std::vector<double> wolff_count(p.wolff ? q : 0, 0); // number of sites in each state
+  if (p.wolff) for (spin_type s : spins) wolff_count[s] += 1;
 
   // observables
   standards::accumulator num_clusters("Number of Clusters"), energy("Energy Density"),
     magnetization2("Order Parameter^2"), magnetization4("Order Parameter^4");
 
-  standards::timer tm;
-  for (unsigned int mcs = 0; mcs < p.therm + p.sweeps; ++mcs) {
-    // initialize cluster information
-    std::fill(fragments.begin(), fragments.end(), fragment_t());
-
-    // cluster generation
-    for (int b = 0; b < lattice.num_bonds(); ++b) {
-      if (spins[lattice.source(b)] == spins[lattice.target(b)] && r_uniform01(eng) < prob)
-        unify(fragments, lattice.source(b), lattice.target(b));
+  // the configuration after a step is measured with its energy, which is given by the number of
+  // satisfied bonds counted in the bond pass of the next step (or by count_satisfied() after the
+  // last one), instead of by a separate pass over bonds
+  struct sample {
+    bool measure;
+    int nc;
+    double mag2, mag4; // improved estimators
+  };
+  sample last = { false, 0, 0, 0 }; // not measured yet
+  auto record = [&](sample const& x, int nsat) {
+    if (x.measure) {
+      num_clusters << (double)x.nc;
+      energy << -nsat / (double)lattice.num_sites();
+      magnetization2 << x.mag2;
+      magnetization4 << x.mag4;
     }
+  };
 
-    // assign cluster id & accumulate cluster properties
-    int nc = 0;
-    double mag2 = 0, mag4 = 0;
-    for (auto& f : fragments) {
-      if (f.is_root()) {
-        f.set_id(nc++);
-        double w = f.weight();
-        mag2 += power2(w);
-        mag4 += power4(w);
+  // flip clusters by random shifts in [0, q); add is spin addition modulo q specialized for common
+  // values of q (see cluster/potts_spin.hpp).  Returns number of clusters.
+  auto flip_clusters = [&](auto add, weight_moments<2, 4>& m) {
+    auto draw = [&](int c, int) {
+      flip[c] = static_cast<spin_type>(add.q() * r_uniform01(cluster::parallel::thread_num()));
+    };
+    auto apply = [&](int s, int c) { spins[s] = add(spins[s], flip[c]); };
+    return p.parallel ? finalize_parallel(fragments, m, draw, apply) :
+      finalize(fragments, m, draw, apply);
+  };
+  auto flip_tiles = [&](auto add, int nc, weight_moments<2, 4>& m) {
+    std::vector<weight_moments<2, 4> > m_thread(engines.size());
+    run([&](int t, int nt) {
+      for (int c = block(nc, t, nt); c < block(nc, t + 1, nt); ++c) {
+        m_thread[t].add(labeler->cluster_weight(c));
+        flip[c] = static_cast<spin_type>(add.q() * r_uniform01(t));
       }
-    }
-    for (auto& f : fragments) f.set_id(cluster_id(fragments, f));
+    });
+    for (auto const& mt : m_thread) m.merge(mt);
+    run([&](int t, int nt) {
+      for (int s = block(ns, t, nt); s < block(ns, t + 1, nt); ++s)
+        spins[s] = add(spins[s], flip[labeler->cluster_id(s)]);
+    });
+  };
 
-    // flip spins
-    for (int c = 0; c < nc; ++c) flip[c] = static_cast<int>(q * r_uniform01(eng));
-    for (int s = 0; s < lattice.num_sites(); ++s)
-      spins[s] = (spins[s] + flip[fragments[s].id()]) % q;
+  // Monte Carlo step with unify policy of type decltype(policy)
+  auto step = [&](auto policy, bool measure) {
+    typedef decltype(policy) policy_t;
+    int nc;
+    weight_moments<2, 4> m;
+    std::vector<int> nsat(engines.size(), 0); // satisfied bonds before flip per thread
+    double fc = 2.0 / (q - 1);
+    if (p.wolff) {
+      // clusters are grown from random sites and shifted by random nonzero amounts until ns spins
+      // are changed in total, which makes an MCS-equivalent.  Each configuration before a flip is
+      // measured, since stopping after the last cluster depends on its size; cluster of size c
+      // gives improved estimators N c and (1 + fc) N c X - fc N c^3 of the second and fourth
+      // moments, where X = (q sum_a n_a^2 - N^2) / (q - 1).  Number of clusters is per
+      // MCS-equivalent.
+      std::vector<cluster::bernoulli> coins(engines.size(), activate);
+      nc = 0;
+      cluster::potts::dispatch(q, [&](auto add) {
+        for (int flipped = 0; flipped < ns; ++nc) {
+          int s0 = ns * r_uniform01(0);
+          spin_type sigma = spins[s0];
+          spin_type sigma_new = add(sigma, static_cast<spin_type>(1 + (q - 1) * r_uniform01(0)));
+          auto bond = [&](int, int t, int th) {
+            return spins[t] == sigma && coins[th](engines[th]);
+          };
+          double c = p.parallel ? wolff->grow_parallel(s0, neighbors, bond) :
+            wolff->grow(s0, neighbors, bond);
+          if (measure) {
+            double x = 0;
+            for (double n : wolff_count) x += n * n;
+            x = (q * x - power2(double(ns))) / (q - 1);
+            energy << -wolff_nsat / (double)lattice.num_sites();
+            magnetization2 << ns * c;
+            magnetization4 << (1 + fc) * ns * c * x - fc * ns * power2(c) * c;
+          }
+          wolff_nsat += flip_cluster([&](int s) {
+            int d = 0;
+            neighbors(s, [&](int t) {
+              if (!wolff->contains(t)) d += (spins[t] == sigma_new) - (spins[t] == sigma);
+            });
+            spins[s] = sigma_new;
+            return d;
+          });
+          wolff_count[sigma] -= c;
+          wolff_count[sigma_new] += c;
+          flipped += c;
+        }
+      });
+      if (measure) num_clusters << (double)nc;
+      return;
+    } else if (!p.tile) {
+      // initialize cluster information
+      if (p.parallel)
+        reset_parallel(fragments);
+      else
+        reset(fragments); // O(1) with -DCLUSTER_USE_EPOCH_RESET
 
-    double ene = 0;
-    for (int b = 0; b < lattice.num_bonds(); ++b) {
-      ene -= (spins[lattice.source(b)] == spins[lattice.target(b)] ? 1.0 : 0.0);
-    }
+      // cluster generation
+      if (!p.run_length) {
+        run([&](int t, int nt) {
+          nsat[t] = for_each_active(t, nt, [&](int b) {
+            unify<policy_t>(fragments, lattice.source(b), lattice.target(b));
+          });
+        });
+      } else {
+        // runs of active bonds (s, s+1) are linked without find.  Each thread collects bonds
+        // whose sources are in its own range of sites; those reaching outside are unified last.
+        int z = LATTICE::dimension; // bonds per site
+        run([&](int t, int nt) {
+          run_collector<policy_t, fragments_t> runs(fragments, pending[t],
+            (block(nb, t, nt) + z - 1) / z, (block(nb, t + 1, nt) + z - 1) / z);
+          nsat[t] =
+            for_each_active(t, nt, [&](int b) { runs.add(lattice.source(b), lattice.target(b)); });
+          runs.flush();
+        });
+        run([&](int t, int) { unify_batch<policy_t>(fragments, pending[t]); });
+      }
+      update_weight<policy_t>(fragments); // no-op unless unify policy does not maintain weight
+
+      // assign cluster id, accumulate cluster properties & flip spins
+      cluster::potts::dispatch(q, [&](auto add) { nc = flip_clusters(add, m); });
+    } else {
+      // cluster generation & labeling by tiles
+      run([&](int t, int nt) {
+        std::fill(active.begin() + block(nb, t, nt), active.begin() + block(nb, t + 1, nt), 0);
+        nsat[t] = for_each_active(t, nt, [&](int b) { active[b] = 1; });
+      });
+      nc = labeler->label([&](int b) { return active[b] != 0; });
 
-    if (mcs >= p.therm) {
-      num_clusters << (double)nc;
-      energy << ene / lattice.num_sites();
-      magnetization2 << mag2;
-      double fc = 2.0 / (q - 1);
-      magnetization4 << ((1+fc) * power2(mag2) - fc * mag4);
+      // accumulate cluster properties & flip spins
+      cluster::potts::dispatch(q, [&](auto add) { flip_tiles(add, nc, m); });
     }
+
+    // the previous step is measured with the energy counted in the bond pass (spins were not
+    // flipped yet), and this one is left for the next step
+    record(last, std::accumulate(nsat.begin(), nsat.end(), 0));
+    last = sample{ measure, nc, m.sum<2>(), (1+fc) * power2(m.sum<2>()) - fc * m.sum<4>() };
+  };
+
+  // unify policy and number of threads, optionally chosen by timing extra steps (not measured)
+  cluster::autotune::config conf = { "default", cluster::parallel::max_threads() };
+  if (p.autotune) {
+    std::string key = "potts Q=" + std::to_string(q) + " L=" + std::to_string(p.length) +
+      " T=" + std::to_string(p.temperature) + " tile=" + std::to_string(p.tile) +
+      (p.dim != 2 ? " d=" + std::to_string(p.dim) : "") + (p.helical ? " helical" : "") +
+      (p.order != site_order::row_major ? std::string(" ") + site_order_name(p.order) : "") +
+      (p.parallel ? " parallel" : "") + (p.run_length ? " run-length" : "") +
+      (p.threshold_bits ? " int=" + std::to_string(p.threshold_bits) : "") +
+      (p.skip ? " skip" : "");
+    // only thread-safe policies for parallel labeling
+    std::vector<std::string> policies = p.tile ? std::vector<std::string>{ "default" } :
+      cluster::autotune::policy_names(p.parallel);
+    conf = cluster::autotune::tuner(key).run([&](auto policy) { step(policy, false); }, policies);
+    cluster::parallel::set_num_threads(conf.threads);
   }
+  if (p.scaling)
+    cluster::autotune::strong_scaling([&](auto policy) { step(policy, false); }, conf.policy);
+
+  standards::timer tm;
+  cluster::autotune::dispatch(conf.policy, [&](auto policy) {
+    for (unsigned int mcs = 0; mcs < p.therm + p.sweeps; ++mcs) step(policy, mcs >= p.therm);
+  });
+  if (!p.wolff) record(last, count_satisfied());
 
   double elapsed = tm.elapsed();
   std::clog << "Elapsed time = " << elapsed << " sec\n"
-            << "Speed = " << (p.therm + p.sweeps) / elapsed << " MCS/sec\n";
+            << "Speed = " << (p.therm + p.sweeps) / elapsed
+            << (p.wolff ? " MCS-equivalent/sec\n" : " MCS/sec\n");
+  if (p.parallel)
+    std::clog << "Threads = " << cluster::parallel::max_threads() << std::endl;
+  cluster::statistics::print(std::clog);
   std::cout << num_clusters << std::endl
             << energy << std::endl
             << magnetization2 << std::endl
@@ -109,3 +351,22 @@ int main(int argc, char* argv[]) {
             << "Binder Ratio of Order Parameter = "
             << power2(magnetization2.mean()) / magnetization4.mean() << std::endl;
 }
+
+int main(int argc, char* argv[]) {
+  std::cout << "Swendsen-Wang Cluster Algorithm for Square Lattice Potts Model\n";
+  options p(argc, argv);
+  if (!p.valid) std::exit(127);
+
+  // hypercubic lattice, optionally with sites ordered along space-filling curve
+  dispatch_dimension(p.dim, [&](auto d) {
+    hypercubic<decltype(d)::value> lattice(p.length, p.helical ? boundary_type::helical :
+                                           boundary_type::periodic);
+    if (p.order == site_order::row_major) {
+      simulate(p, lattice);
+    } else {
+      ordered_hypercubic<decltype(d)::value> ordered(lattice, p.order);
+      print_locality(ordered, sizeof(cluster::union_find::node));
+      simulate(p, ordered);
+    }
+  });
+}
@@ -0,0 +1,179 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@comp-phys.org>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// Space-filling-curve site ordering of hypercubic lattice
+//
+// ordered_hypercubic<D> relabels the sites of hypercubic<D> in order of their Morton (Z-order)
+// or Hilbert index, so that neighbors along every axis, not only the fastest one, tend to be close
+// in memory.  Sites are numbered by rank r along the curve (the lattice is embedded in a cube of
+// side 2^m >= L, so that any L can be used), and bonds are b = D r + k, i.e. bonds are visited in
+// order of their source along the curve.  Since spins, cluster information and measurements are
+// all indexed by site, programs need no other change.  Neighbors are looked up through the
+// permutation tables, except for Morton order with periodic boundary conditions and L = 2^m, for
+// which they are computed directly from the index.  locality() reports how far apart in
+// memory the two ends of bonds are.
+//
+// Example:
+//   ordered_hypercubic<3> lattice(hypercubic<3>(L), site_order::hilbert);
+//   std::clog << locality(lattice, sizeof(cluster::union_find::node)) << std::endl;
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "hypercubic.hpp"
+
+enum class site_order { row_major, morton, hilbert };
+
+inline const char* site_order_name(site_order order) {
+  switch (order) {
+  case site_order::morton: return "morton";
+  case site_order::hilbert: return "hilbert";
+  default: return "row-major";
+  }
+}
+
+// returns false for unknown name
+inline bool parse_site_order(std::string const& name, site_order& order) {
+  for (auto o : { site_order::row_major, site_order::morton, site_order::hilbert }) {
+    if (name == site_order_name(o)) { order = o; return true; }
+  }
+  return false;
+}
+
+// position along the curve of point x (D coordinates of m bits each; D m <= 64)
+template<int D>
+std::uint64_t curve_index(site_order order, std::uint32_t const* x, int m) {
+  std::uint32_t y[D];
+  std::copy(x, x + D, y);
+  if (order == site_order::hilbert) {
+    // transpose of Hilbert index (J. Skilling, AIP Conf. Proc. 707, 381 (2004))
+    for (std::uint32_t q = std::uint32_t(1) << (m - 1); q > 1; q >>= 1) {
+      std::uint32_t p = q - 1;
+      for (int k = 0; k < D; ++k) {
+        if (y[k] & q) {
+          y[0] ^= p;
+        } else {
+          std::uint32_t t = (y[0] ^ y[k]) & p;
+          y[0] ^= t;
+          y[k] ^= t;
+        }
+      }
+    }
+    for (int k = 1; k < D; ++k) y[k] ^= y[k - 1];
+    std::uint32_t t = 0;
+    for (std::uint32_t q = std::uint32_t(1) << (m - 1); q > 1; q >>= 1)
+      if (y[D - 1] & q) t ^= q - 1;
+    for (int k = 0; k < D; ++k) y[k] ^= t;
+  }
+  // interleave bits, most significant first
+  std::uint64_t h = 0;
+  for (int j = m - 1; j >= 0; --j)
+    for (int k = 0; k < D; ++k) h = (h << 1) | ((y[k] >> j) & 1);
+  return h;
+}
+
+template<int D>
+class ordered_hypercubic {
+public:
+  static const int dimension = D;
+
+  ordered_hypercubic(hypercubic<D> const& base, site_order order) :
+    base_(base), order_(order), rank_(base.num_sites()), site_(base.num_sites()) {
+    int m = 1;
+    while ((std::size_t(1) << m) < base.length()) ++m;
+    std::vector<std::uint64_t> key(num_sites());
+    for (std::size_t s = 0; s < num_sites(); ++s) {
+      std::uint32_t x[D];
+      for (std::size_t k = 0, t = s; k < D; ++k, t /= base.length()) x[k] = t % base.length();
+      key[s] = (order == site_order::row_major) ? s : curve_index<D>(order, x, m);
+    }
+    // Morton index itself is rank, and neighbors are computed by dilated integer arithmetic
+    dilated_ = (order == site_order::morton) && (std::size_t(1) << m) == base.length() &&
+      base.boundary() == boundary_type::periodic;
+    for (int k = 0; k < D; ++k) {
+      mask_[k] = 0;
+      for (int j = 0; j < m; ++j) mask_[k] |= std::uint64_t(1) << (j * D + D - 1 - k);
+    }
+    std::iota(site_.begin(), site_.end(), 0);
+    std::sort(site_.begin(), site_.end(),
+              [&](std::uint32_t s0, std::uint32_t s1) { return key[s0] < key[s1]; });
+    for (std::size_t r = 0; r < num_sites(); ++r) rank_[site_[r]] = r;
+  }
+
+  hypercubic<D> const& base() const { return base_; }
+  site_order order() const { return order_; }
+  std::size_t num_sites() const { return base_.num_sites(); }
+  std::size_t num_bonds() const { return base_.num_bonds(); }
+  std::size_t source(std::size_t b) const { return b / D; }
+  std::size_t target(std::size_t b) const { return neighbor(b / D, b % D); }
+
+  // neighbors of rank r in +k and -k directions
+  std::size_t neighbor(std::size_t r, int k) const {
+    if (dilated_) return (((r | ~mask_[k]) + 1) & mask_[k]) | (r & ~mask_[k]);
+    return rank_[base_.neighbor(site_[r], k)];
+  }
+  std::size_t opposite_neighbor(std::size_t r, int k) const {
+    if (dilated_) return (((r & mask_[k]) - 1) & mask_[k]) | (r & ~mask_[k]);
+    return rank_[base_.opposite_neighbor(site_[r], k)];
+  }
+
+  // rank along the curve of site s of the base lattice, and vice versa
+  std::size_t rank(std::size_t s) const { return rank_[s]; }
+  std::size_t site(std::size_t r) const { return site_[r]; }
+
+private:
+  hypercubic<D> base_;
+  site_order order_;
+  std::vector<std::uint32_t> rank_, site_;
+  bool dilated_;
+  std::uint64_t mask_[D]; // bits of k-th coordinate in Morton index
+};
+
+// memory distance between the two ends of bonds, for bytes_per_site bytes of data per site
+struct locality_metrics {
+  double typical_distance; // geometric mean of |source - target| in sites
+  double same_line;        // fraction of bonds whose ends share a cache line (64 bytes)
+  double same_page;        // fraction of bonds whose ends share a page (4 kB)
+};
+
+template<class LATTICE>
+locality_metrics locality(LATTICE const& lattice, std::size_t bytes_per_site) {
+  std::size_t nb = lattice.num_bonds();
+  double logd = 0, line = 0, page = 0;
+  for (std::size_t b = 0; b < nb; ++b) {
+    std::size_t s0 = lattice.source(b), s1 = lattice.target(b);
+    logd += std::log((s0 > s1) ? s0 - s1 : s1 - s0);
+    line += (s0 * bytes_per_site / 64 == s1 * bytes_per_site / 64);
+    page += (s0 * bytes_per_site / 4096 == s1 * bytes_per_site / 4096);
+  }
+  return locality_metrics{ std::exp(logd / nb), line / nb, page / nb };
+}
+
+inline std::ostream& operator<<(std::ostream& os, locality_metrics const& m) {
+  return os << "typical bond distance = " << m.typical_distance << ", same cache line = "
+            << m.same_line << ", same page = " << m.same_page;
+}
+
+// locality of row-major and curve ordering
+template<int D>
+void print_locality(ordered_hypercubic<D> const& lattice, std::size_t bytes_per_site,
+                    std::ostream& os = std::clog) {
+  os << "Locality (row-major): " << locality(lattice.base(), bytes_per_site) << std::endl
+     << "Locality (" << site_order_name(lattice.order()) << "): "
+     << locality(lattice, bytes_per_site) << std::endl;
+}
@@ -0,0 +1,74 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that the effective probability of integer-threshold Bernoulli trials is within the
+// documented bound, that the frequency of success agrees with it for 32- and 64-bit engines, and
+// that bits = 0 reproduces comparison with double uniforms
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include "cluster/bernoulli.hpp"
+
+template<class RNG>
+bool check_frequency(double p, int bits, unsigned int seed) {
+  RNG eng(seed);
+  cluster::bernoulli coin(p, bits);
+  int n = 1 << 20;
+  int count = 0;
+  for (int i = 0; i < n; ++i) count += coin(eng);
+  double pe = coin.probability();
+  double sigma = std::sqrt(n * pe * (1 - pe));
+  bool ok = std::abs(count - n * pe) <= 5 * sigma + 1e-12;
+  if (!ok)
+    std::cerr << "p = " << p << ", bits = " << bits << ": " << count << " successes in " << n
+              << " trials\n";
+  return ok;
+}
+
+int main() {
+  unsigned int seed = 2357;
+  double ps[] = { 0, 1e-3, 0.25, 0.5, 1 - std::exp(-2 / 2.27), 1 - std::exp(-1 / 0.994973),
+                  0.999, 1 };
+  int bits[] = { 1, 8, 16, 21, 32, 48, 64 };
+  bool match = true;
+  for (double p : ps) {
+    for (int b : bits) {
+      cluster::bernoulli coin(p, b);
+      double bound = (b == 64) ? std::ldexp(1.0, -64) : std::ldexp(1.0, -(b + 1));
+      double error = std::abs(coin.probability() - p);
+      bool ok = (coin.bits() == b) && (error <= bound) &&
+        check_frequency<std::mt19937>(p, b, seed) && check_frequency<std::mt19937_64>(p, b, seed);
+      std::clog << "p = " << p << ", bits = " << b << ", error = " << error << ", "
+                << (ok ? "ok" : "failed") << std::endl;
+      match = match && ok;
+    }
+  }
+
+  // p = 0 never succeeds, and p = 1 always does
+  for (int b : bits) {
+    std::mt19937 eng(seed);
+    cluster::bernoulli never(0, b), always(1, b);
+    for (int i = 0; i < 1000; ++i) match = match && !never(eng) && always(eng);
+  }
+
+  // bits = 0 gives the same sequence as uniform_real_distribution
+  std::mt19937 eng0(seed), eng1(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  cluster::bernoulli coin(0.3);
+  for (int i = 0; i < 100000; ++i) match = match && (coin(eng0) == (r_uniform01(eng1) < 0.3));
+
+  if (!match) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that deterministic_unify_policy gives the same roots, weights and cluster id as serial
+// execution for any number of threads
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <lattice/graph.hpp>
+#include "cluster/union_find.hpp"
+
+template<typename FRAGMENTS>
+bool test(lattice::graph const& lattice, std::vector<int> const& bonds, int max_threads) {
+  using namespace cluster::union_find;
+  typedef deterministic_unify_policy policy;
+  std::size_t n = lattice.num_sites();
+  std::size_t nb = bonds.size();
+
+  // serial reference
+  FRAGMENTS fragments_s(n);
+  for (std::size_t b = 0; b < nb; ++b)
+    if (bonds[b]) unify<policy>(fragments_s, lattice.source(b), lattice.target(b));
+  int nc_s = set_id(fragments_s, 0, n, 0);
+  copy_id(fragments_s, 0, n);
+
+  bool match = true;
+  for (int nt = 1; nt <= max_threads; ++nt) {
+    cluster::parallel::set_num_threads(nt);
+    FRAGMENTS fragments(n);
+    cluster::parallel::for_each_dynamic(std::size_t(0), nb, std::size_t(16), [&](std::size_t b) {
+      if (bonds[b]) unify<policy>(fragments, lattice.source(b), lattice.target(b));
+    });
+    int nc = assign_id(fragments);
+    bool m = (nc == nc_s);
+    for (std::size_t i = 0; i < n; ++i) {
+      m = m && (fragments[i].is_root() == fragments_s[i].is_root()) &&
+        (fragments[i].id() == fragments_s[i].id()) &&
+        (!fragments[i].is_root() || fragments[i].weight() == fragments_s[i].weight()) &&
+        (root_index(fragments, i) <= static_cast<int>(i)); // root is the smallest index
+    }
+    std::clog << "number of threads = " << nt << ", number of clusters = " << nc_s << ", "
+              << nc << ", " << (m ? "identical" : "different") << std::endl;
+    match = match && m;
+  }
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+int main() {
+  int seed = 2357;
+  int length = 128;
+  int max_threads = 4;
+
+  // square lattice at the percolation threshold
+  auto lattice = lattice::graph::simple(2, length);
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(lattice.num_bonds());
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < 0.5);
+
+  if (!test<std::vector<cluster::union_find::node> >(lattice, bonds, max_threads)) return 127;
+  if (!test<cluster::union_find::forest>(lattice, bonds, max_threads)) return 127;
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that finalize and finalize_parallel give the same cluster id, moments and callbacks as
+// assign_id followed by separate loops, for any number of threads; the callback per cluster also
+// takes its root, and moments of finalize_parallel are bit-identical for any number of threads
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <lattice/graph.hpp>
+#include "cluster/finalize.hpp"
+
+template<typename FRAGMENTS>
+bool test(lattice::graph const& lattice, std::vector<int> const& bonds, int max_threads) {
+  using namespace cluster::union_find;
+  int n = lattice.num_sites();
+  int nb = bonds.size();
+  FRAGMENTS fragments(n);
+  auto generate = [&]() {
+    reset(fragments);
+    for (int b = 0; b < nb; ++b)
+      if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
+  };
+
+  // reference
+  generate();
+  int nc_s = assign_id(fragments);
+  std::vector<int> id_s(n), weight_s(nc_s);
+  double mag2_s = 0, mag4_s = 0;
+  for (int s = 0; s < n; ++s) {
+    id_s[s] = fragments[s].id();
+    if (fragments[s].is_root()) {
+      double w = fragments[s].weight();
+      weight_s[fragments[s].id()] = w;
+      mag2_s += w * w;
+      mag4_s += (w * w) * (w * w);
+    }
+  }
+
+  bool match = true;
+  double mag2_p = -1, mag4_p = -1; // finalize_parallel with 1 thread
+  for (int nt = 1; nt <= max_threads; ++nt) {
+    cluster::parallel::set_num_threads(nt);
+    for (int par = 0; par < 2; ++par) {
+      generate();
+      weight_moments<1, 2, 4> m;
+      std::vector<int> weight(n, -1), id(n, -1);
+      std::atomic<int> order_violations(0), root_violations(0);
+      int last = -1;
+      auto cluster = [&](int c, int w, int r) {
+        if (!par) {
+          if (c != last + 1) ++order_violations; // called in order of id
+          last = c;
+        }
+        if (id_s[r] != c || !fragments[r].is_root()) ++root_violations; // r is root of cluster c
+        weight[c] = w;
+      };
+      auto site = [&](int s, int c) { id[s] = c; };
+      int nc = par ? finalize_parallel(fragments, m, cluster, site) :
+        finalize(fragments, m, cluster, site);
+      // finalize_parallel sums moments in different order
+      bool ok = (nc == nc_s) && (order_violations == 0) && (root_violations == 0) &&
+        (m.sum<1>() == n) &&
+        (std::abs(m.sum<2>() - mag2_s) <= 1e-12 * mag2_s) &&
+        (std::abs(m.sum<4>() - mag4_s) <= 1e-12 * mag4_s);
+      if (par && nt == 1) {
+        mag2_p = m.sum<2>();
+        mag4_p = m.sum<4>();
+      }
+      if (par) ok = ok && (m.sum<2>() == mag2_p) && (m.sum<4>() == mag4_p);
+      for (int s = 0; ok && s < n; ++s)
+        ok = (id[s] == id_s[s]) && (fragments[s].id() == id_s[s]);
+      for (int c = 0; ok && c < nc; ++c) ok = (weight[c] == weight_s[c]);
+      std::clog << (par ? "finalize_parallel" : "finalize") << ": number of threads = " << nt
+                << ", number of clusters = " << nc_s << ", " << nc << ", "
+                << (ok ? "identical" : "different") << std::endl;
+      match = match && ok;
+    }
+  }
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+int main() {
+  int seed = 2357;
+  int length = 128;
+  int max_threads = 4;
+
+  // square lattice at the percolation threshold
+  auto lattice = lattice::graph::simple(2, length);
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(lattice.num_bonds());
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < 0.5);
+
+  if (!test<std::vector<cluster::union_find::node> >(lattice, bonds, max_threads)) return 127;
+  if (!test<cluster::union_find::forest>(lattice, bonds, max_threads)) return 127;
+  if (!test<cluster::union_find::epoch_forest>(lattice, bonds, max_threads)) return 127;
+  return 0;
+}
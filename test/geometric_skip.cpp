@@ -0,0 +1,72 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that geometric skipping selects each candidate independently with probability p, i.e. the
+// frequency of success at every position and the frequency of adjacent pairs agree with p and p^2
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "cluster/geometric_skip.hpp"
+
+int main() {
+  unsigned int seed = 2357;
+  int n = 64;
+  int samples = 1 << 16;
+  double ps[] = { 0, 0.01, 0.2, 0.5, 1 - std::exp(-2 / 2.27), 0.9, 1 };
+
+  bool match = true;
+  for (double p : ps) {
+    std::mt19937 eng(seed);
+    cluster::geometric_skip skip(p);
+    std::vector<int> count(n, 0), pair(n - 1, 0);
+    for (int k = 0; k < samples; ++k) {
+      std::vector<char> hit(n, 0);
+      std::uint64_t last = 0;
+      bool increasing = true;
+      bool first = true;
+      skip.for_each_success(n, eng, [&](std::uint64_t i) {
+        increasing = increasing && (first || i > last);
+        first = false;
+        last = i;
+        hit[i] = 1;
+      });
+      match = match && increasing;
+      for (int i = 0; i < n; ++i) count[i] += hit[i];
+      for (int i = 0; i < n - 1; ++i) pair[i] += hit[i] && hit[i + 1];
+    }
+    // largest deviation in units of standard deviation
+    double dev = 0;
+    for (int i = 0; i < n; ++i) {
+      double sigma = std::sqrt(samples * p * (1 - p));
+      double d = std::abs(count[i] - samples * p);
+      dev = std::max(dev, sigma > 0 ? d / sigma : (d > 0 ? 1e10 : 0));
+    }
+    for (int i = 0; i < n - 1; ++i) {
+      double sigma = std::sqrt(samples * p * p * (1 - p * p));
+      double d = std::abs(pair[i] - samples * p * p);
+      dev = std::max(dev, sigma > 0 ? d / sigma : (d > 0 ? 1e10 : 0));
+    }
+    bool ok = (dev < 5);
+    std::clog << "p = " << p << ": largest deviation = " << dev << " sigma, "
+              << (ok ? "ok" : "failed") << std::endl;
+    match = match && ok;
+  }
+
+  if (!match) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  return 0;
+}
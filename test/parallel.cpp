@@ -11,35 +11,24 @@
 
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 #include <random>
 #include <lattice/graph.hpp>
+#include "cluster/huge_page_allocator.hpp"
 #include "cluster/union_find.hpp"
 
-int main(int argc, char* argv[]) {
-  std::size_t num_threads = omp_get_max_threads();
-  int seed = 12345;
-  int length = 64;
-  double p = 0.5;
-
-  // square lattice
-  auto lattice = lattice::graph::simple(2, length);
-
-  // generate random bonds
-  std::mt19937 eng(seed);
-  std::uniform_real_distribution<> r_uniform01;
-  std::vector<int> bonds(lattice.num_bonds());
-  for (auto& bond : bonds) bond = (r_uniform01(eng) < p);
-
-  // cluster information
-  typedef cluster::union_find::node fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
+template<typename FRAGMENTS, typename POLICY = cluster::union_find::default_unify_policy>
+bool test(lattice::graph const& lattice, std::vector<int> const& bonds, bool verbose = true) {
+  FRAGMENTS fragments(lattice.num_sites());
+  typedef typename FRAGMENTS::value_type fragment_t;
 
   //
   // serial execution
   //
   
-  std::fill(fragments.begin(), fragments.end(), fragment_t());
+  for (std::size_t i = 0; i < fragments.size(); ++i) fragments[i] = fragment_t();
 
   for (std::size_t b = 0; b < bonds.size(); ++b)
     if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
@@ -48,7 +37,8 @@ int main(int argc, char* argv[]) {
   std::size_t nc_s = 0;
   std::size_t wmax_s = 0;
   std::size_t w2_s = 0;
-  for (auto& f : fragments) {
+  for (std::size_t i = 0; i < fragments.size(); ++i) {
+    auto&& f = fragments[i];
     if (f.is_root()) {
       ++nc_s;
       std::size_t w = f.weight();
@@ -58,20 +48,24 @@ int main(int argc, char* argv[]) {
   }
 
   //
-  // openmp execution
+  // parallel execution
   //
   
-  std::fill(fragments.begin(), fragments.end(), fragment_t());
+  for (std::size_t i = 0; i < fragments.size(); ++i) fragments[i] = fragment_t();
 
-  #pragma omp parallel for
-  for (std::size_t b = 0; b < bonds.size(); ++b)
-    if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
+  std::size_t nb = bonds.size();
+  cluster::parallel::for_each_dynamic(std::size_t(0), nb, std::size_t(64), [&](std::size_t b) {
+    if (bonds[b])
+      cluster::union_find::unify<POLICY>(fragments, lattice.source(b), lattice.target(b));
+  });
+  cluster::union_find::update_weight<POLICY>(fragments);
   
   // accumulate cluster properties
   std::size_t nc_p = 0;
   std::size_t wmax_p = 0;
   std::size_t w2_p = 0;
-  for (auto& f : fragments) {
+  for (std::size_t i = 0; i < fragments.size(); ++i) {
+    auto&& f = fragments[i];
     if (f.is_root()) {
       ++nc_p;
       std::size_t w = f.weight();
@@ -80,14 +74,199 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  std::clog << "number of threads = 1, " << num_threads << std::endl
-            << "number of clusters = " << nc_s << ", " << nc_p << std::endl
-            << "largest cluster size = " << wmax_s << ", " << wmax_p << std::endl
-            << "sum of square of cluster size = " << w2_s << ", " << w2_p << std::endl;
+  // cluster numbering (serial and two-phase parallel)
+  FRAGMENTS fragments_s(fragments);
+  int nid_s = set_id(fragments_s, 0, fragments_s.size(), 0);
+  copy_id(fragments_s, 0, fragments_s.size());
+  int nid_p = assign_id(fragments);
+  bool id_match = (nid_s == nid_p);
+  for (std::size_t i = 0; i < fragments.size(); ++i)
+    id_match = id_match && (fragments_s[i].id() == fragments[i].id());
+
+  if (verbose)
+    std::clog << "number of threads = 1, " << cluster::parallel::max_threads() << std::endl
+              << "number of clusters = " << nc_s << ", " << nc_p << std::endl
+              << "largest cluster size = " << wmax_s << ", " << wmax_p << std::endl
+              << "sum of square of cluster size = " << w2_s << ", " << w2_p << std::endl
+              << "cluster id = " << (id_match ? "match" : "mismatch") << std::endl;
 
-  if (nc_s != nc_p || wmax_s != wmax_p || w2_s != w2_p) {
+  if (nc_s != nc_p || wmax_s != wmax_p || w2_s != w2_p || !id_match) {
     std::cerr << "result mismatch\n";
+    return false;
+  }
+  return true;
+}
+
+// root and cluster id found from a copy of node agree with those found from its index, also for
+// basic_forest whose nodes are given by proxy
+template<typename FRAGMENTS>
+bool test_root(lattice::graph const& lattice, std::vector<int> const& bonds) {
+  using namespace cluster::union_find;
+  typedef typename FRAGMENTS::value_type fragment_t;
+  FRAGMENTS fragments(lattice.num_sites());
+  for (std::size_t b = 0; b < bonds.size(); ++b)
+    if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
+  int nc = assign_id(fragments);
+  bool match = true;
+  for (std::size_t i = 0; i < fragments.size(); ++i) {
+    fragment_t n = fragments[i];
+    fragment_t r = root(fragments, n);
+    match = match && r.is_root() && (r.id() == root(fragments, int(i)).id()) &&
+      (cluster_id(fragments, n) == cluster_id(fragments, int(i))) &&
+      (cluster_id(fragments, n) < nc);
+  }
+  std::clog << "root of node copy: cluster id = " << (match ? "match" : "mismatch") << std::endl;
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+// union-find on a view of a slice of larger buffer gives the same clusters as on std::vector
+bool test_span(lattice::graph const& lattice, std::vector<int> const& bonds) {
+  using namespace cluster::union_find;
+  std::size_t n = lattice.num_sites();
+  std::vector<node> fragments(n);
+  std::vector<node, cluster::huge_page_allocator<node> > buffer(3 * n);
+  span<node> view = span<node>(buffer).subspan(n, n);
+  std::size_t nb = bonds.size();
+  cluster::parallel::for_each_dynamic(std::size_t(0), nb, std::size_t(64), [&](std::size_t b) {
+    if (bonds[b]) {
+      unify(fragments, lattice.source(b), lattice.target(b));
+      unify(view, lattice.source(b), lattice.target(b));
+    }
+  });
+  int nc = assign_id(fragments);
+  int nc_v = assign_id(view);
+  bool match = (nc == nc_v);
+  for (std::size_t i = 0; i < n; ++i)
+    match = match && (fragments[i].id() == view[i].id()) &&
+      (!fragments[i].is_root() || fragments[i].weight() == view[i].weight());
+  for (std::size_t i = 0; i < n; ++i)
+    match = match && buffer[i].is_root() && buffer[i].weight() == 1 &&
+      buffer[2 * n + i].is_root() && buffer[2 * n + i].weight() == 1;
+  std::clog << "span: number of clusters = " << nc << ", " << nc_v << ", cluster id = "
+            << (match ? "match" : "mismatch") << std::endl;
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+// epoch_forest reused with O(1) reset gives the same clusters as std::vector initialized every time
+template<typename FOREST>
+bool test_epoch(lattice::graph const& lattice, std::mt19937& eng) {
+  using namespace cluster::union_find;
+  std::size_t n = lattice.num_sites();
+  std::size_t nb = lattice.num_bonds();
+  std::uniform_real_distribution<> r_uniform01;
+  FOREST forest(n);
+  bool match = true;
+  for (int t = 0; t < 8; ++t) {
+    std::vector<int> bonds(nb);
+    for (auto& bond : bonds) bond = (r_uniform01(eng) < 0.25 + 0.05 * t);
+    std::vector<node> fragments(n);
+    for (int k = 0; k < 40; ++k) forest.reset(); // epoch wraps around during the test
+    cluster::parallel::for_each_dynamic(std::size_t(0), nb, std::size_t(64), [&](std::size_t b) {
+      if (bonds[b]) {
+        unify<deterministic_unify_policy>(fragments, lattice.source(b), lattice.target(b));
+        unify<deterministic_unify_policy>(forest, lattice.source(b), lattice.target(b));
+      }
+    });
+    int nc = assign_id(fragments);
+    int nc_f = assign_id(forest);
+    match = match && (nc == nc_f);
+    for (std::size_t i = 0; i < n; ++i)
+      match = match && (fragments[i].id() == forest[i].id()) &&
+        (fragments[i].is_root() == forest[i].is_root()) &&
+        (!fragments[i].is_root() || fragments[i].weight() == forest[i].weight());
+  }
+  std::clog << "epoch_forest: epoch = " << forest.epoch() << ", cluster id = "
+            << (match ? "match" : "mismatch") << std::endl;
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+// epoch_forest refuses more nodes than its parent word can address, and wide_epoch_forest keeps
+// parent index and weight beyond the limit of epoch_forest
+bool test_epoch_limit() {
+  using namespace cluster::union_find;
+  bool match = (epoch_forest::max_nodes == (1 << 23) - 1) &&
+    (wide_epoch_forest::max_nodes == std::numeric_limits<int>::max());
+  auto throws = [](auto const& f) {
+    try { f(); } catch (std::length_error const&) { return true; }
+    return false;
+  };
+  match = match && throws([] { epoch_forest forest(epoch_forest::max_nodes + 1); });
+  match = match && throws([] { epoch_forest forest(4); forest.resize(1 << 24); });
+  match = match && !throws([] { epoch_forest forest(4); forest.resize(16); });
+  wide_epoch_forest forest(4);
+  int big = std::numeric_limits<int>::max() - 1;
+  forest[0].set_weight(big);
+  forest[1].set_parent(big);
+  match = match && forest[0].is_root() && forest[0].weight() == big &&
+    !forest[1].is_root() && forest[1].parent() == big && forest[2].is_root() &&
+    forest[2].weight() == 1;
+  std::clog << "epoch_forest: size limit " << (match ? "ok" : "failed") << std::endl;
+  if (!match) std::cerr << "result mismatch\n";
+  return match;
+}
+
+int main(int argc, char* argv[]) {
+  int seed = 12345;
+  int length = 64;
+  double p = 0.5;
+
+  // square lattice
+  auto lattice = lattice::graph::simple(2, length);
+
+  // generate random bonds
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(lattice.num_bonds());
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < p);
+
+  if (!test<std::vector<cluster::union_find::node> >(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node16> >(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node64> >(lattice, bonds)) return 127;
+  if (!test<cluster::union_find::forest>(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node>, cluster::union_find::pathhalving_by_rank>(
+        lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node>, cluster::union_find::rem_splicing>(
+        lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node>, cluster::union_find::link_by_index>(
+        lattice, bonds)) return 127;
+  if (!test<cluster::union_find::forest, cluster::union_find::rem_splicing>(lattice, bonds))
+    return 127;
+  if (!test<std::vector<cluster::union_find::node,
+                       cluster::huge_page_allocator<cluster::union_find::node> > >(lattice, bonds))
     return 127;
+  if (!test<cluster::union_find::basic_forest<int, cluster::huge_page_allocator<int> > >(
+        lattice, bonds)) return 127;
+  if (!test<cluster::union_find::epoch_forest>(lattice, bonds)) return 127;
+  if (!test<cluster::union_find::epoch_forest, cluster::union_find::rem_splicing>(lattice, bonds))
+    return 127;
+  if (!test<cluster::union_find::wide_epoch_forest>(lattice, bonds)) return 127;
+  if (!test_root<std::vector<cluster::union_find::node> >(lattice, bonds)) return 127;
+  if (!test_root<cluster::union_find::forest>(lattice, bonds)) return 127;
+  if (!test_span(lattice, bonds)) return 127;
+  if (!test_epoch<cluster::union_find::epoch_forest>(lattice, eng)) return 127;
+  if (!test_epoch<cluster::union_find::wide_epoch_forest>(lattice, eng)) return 127;
+  if (!test_epoch_limit()) return 127;
+
+  // randomized stress test with various bond densities around the percolation threshold
+  // (configure with -DCLUSTER_USE_TSAN=ON and run ctest -L tsan to check data races)
+  int trials = 32;
+  std::uniform_real_distribution<> r_prob(0.3, 0.7);
+  for (int t = 0; t < trials; ++t) {
+    double q = r_prob(eng);
+    for (auto& bond : bonds) bond = (r_uniform01(eng) < q);
+    if (!test<std::vector<cluster::union_find::node> >(lattice, bonds, false) ||
+        !test<std::vector<cluster::union_find::node>, cluster::union_find::rem_splicing>(
+          lattice, bonds, false) ||
+        !test<std::vector<cluster::union_find::node>, cluster::union_find::link_by_index>(
+          lattice, bonds, false) ||
+        !test<cluster::union_find::forest>(lattice, bonds, false)) {
+      std::cerr << "stress test failed at trial " << t << " (bond density = " << q << ")\n";
+      return 127;
+    }
   }
+  std::clog << "stress test: " << trials << " trials passed\n";
   return 0;
 }
@@ -16,30 +16,16 @@
 #include <lattice/graph.hpp>
 #include "cluster/union_find.hpp"
 
-int main(int argc, char* argv[]) {
-  std::size_t num_threads = omp_get_max_threads();
-  int seed = 12345;
-  int length = 64;
-  double p = 0.5;
-
-  // square lattice
-  auto lattice = lattice::graph::simple(2, length);
-
-  // generate random bonds
-  std::mt19937 eng(seed);
-  std::uniform_real_distribution<> r_uniform01;
-  std::vector<int> bonds(lattice.num_bonds());
-  for (auto& bond : bonds) bond = (r_uniform01(eng) < p);
-
-  // cluster information
-  typedef cluster::union_find::node_noweight fragment_t;
-  std::vector<fragment_t> fragments(lattice.num_sites());
+template<typename FRAGMENTS, typename POLICY = cluster::union_find::default_unify_policy>
+bool test(lattice::graph const& lattice, std::vector<int> const& bonds) {
+  FRAGMENTS fragments(lattice.num_sites());
+  typedef typename FRAGMENTS::value_type fragment_t;
 
   //
   // serial execution
   //
   
-  std::fill(fragments.begin(), fragments.end(), fragment_t());
+  for (std::size_t i = 0; i < fragments.size(); ++i) fragments[i] = fragment_t();
 
   for (std::size_t b = 0; b < bonds.size(); ++b)
     if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
@@ -62,14 +48,14 @@ int main(int argc, char* argv[]) {
   }
 
   //
-  // openmp execution
+  // parallel execution
   //
   
-  std::fill(fragments.begin(), fragments.end(), fragment_t());
+  for (std::size_t i = 0; i < fragments.size(); ++i) fragments[i] = fragment_t();
 
-  #pragma omp parallel for
-  for (std::size_t b = 0; b < bonds.size(); ++b)
-    if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
+  cluster::parallel::for_each(std::size_t(0), bonds.size(), [&](std::size_t b) {
+    if (bonds[b]) cluster::union_find::unify<POLICY>(fragments, lattice.source(b), lattice.target(b));
+  });
   
   // accumulate cluster properties
   std::size_t nc_p = 0;
@@ -88,14 +74,46 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  std::clog << "number of threads = 1, " << num_threads << std::endl
+  // cluster numbering (serial and two-phase parallel)
+  FRAGMENTS fragments_s(fragments);
+  int nid_s = set_id(fragments_s, 0, fragments_s.size(), 0);
+  copy_id(fragments_s, 0, fragments_s.size());
+  int nid_p = assign_id(fragments);
+  bool id_match = (nid_s == nid_p);
+  for (std::size_t i = 0; i < fragments.size(); ++i)
+    id_match = id_match && (fragments_s[i].id() == fragments[i].id());
+
+  std::clog << "number of threads = 1, " << cluster::parallel::max_threads() << std::endl
             << "number of clusters = " << nc_s << ", " << nc_p << std::endl
             << "largest cluster size = " << wmax_s << ", " << wmax_p << std::endl
-            << "sum of square of cluster size = " << w2_s << ", " << w2_p << std::endl;
+            << "sum of square of cluster size = " << w2_s << ", " << w2_p << std::endl
+            << "cluster id = " << (id_match ? "match" : "mismatch") << std::endl;
 
-  if (nc_s != nc_p || wmax_s != wmax_p || w2_s != w2_p) {
+  if (nc_s != nc_p || wmax_s != wmax_p || w2_s != w2_p || !id_match) {
     std::cerr << "result mismatch\n";
-    return 127;
+    return false;
   }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  int seed = 12345;
+  int length = 64;
+  double p = 0.5;
+
+  // square lattice
+  auto lattice = lattice::graph::simple(2, length);
+
+  // generate random bonds
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(lattice.num_bonds());
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < p);
+
+  if (!test<std::vector<cluster::union_find::node_noweight> >(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node_noweight16> >(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node_noweight64> >(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node_noweight>, cluster::union_find::rem_splicing>(lattice, bonds)) return 127;
+  if (!test<std::vector<cluster::union_find::node_noweight>, cluster::union_find::link_by_index>(lattice, bonds)) return 127;
   return 0;
 }
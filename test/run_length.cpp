@@ -0,0 +1,109 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that run-length collapsing followed by unify of the other bonds gives the same clusters
+// and cluster sizes as unify of all the bonds, for every thread-safe unify policy and number of
+// threads
+
+// every unify policy is known to autotune::dispatch()
+#define CLUSTER_AUTOTUNE_ALL_POLICIES
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <random>
+#include <lattice/graph.hpp>
+#include "cluster/autotune.hpp"
+#include "cluster/run_length.hpp"
+
+int main() {
+  using namespace cluster::union_find;
+  int seed = 2357;
+  int length = 128;
+  int max_threads = 4;
+
+  // square lattice above the percolation threshold, where runs are long
+  int dim = 2;
+  auto lattice = lattice::graph::simple(dim, length);
+  int n = lattice.num_sites();
+  int nb = lattice.num_bonds();
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(nb);
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < 0.7);
+
+  // serial reference
+  std::vector<node> reference(n);
+  for (int b = 0; b < nb; ++b)
+    if (bonds[b]) unify(reference, lattice.source(b), lattice.target(b));
+  int nc_s = assign_id(reference);
+  std::vector<int> weight_s(nc_s);
+  for (int s = 0; s < n; ++s)
+    if (reference[s].is_root()) weight_s[reference[s].id()] = reference[s].weight();
+
+  bool match = true;
+  // policies that may unify concurrently, and a policy that may not
+  std::vector<std::string> names = cluster::autotune::policy_names(true);
+  for (std::string name : { "pathhalving_by_weight", "pathhalving_by_index", "rem_splicing",
+                            "link_by_index" })
+    match = match && (std::find(names.begin(), names.end(), name) != names.end());
+  match = match && (std::find(names.begin(), names.end(), "compress_by_weight") == names.end());
+  if (!match) std::cerr << "wrong list of thread-safe policies\n";
+
+  for (auto const& name : names) {
+    cluster::autotune::dispatch(name, [&](auto policy) {
+      typedef decltype(policy) policy_t;
+      typedef std::vector<node> fragments_t;
+      for (int nt = 1; nt <= max_threads; ++nt) {
+        cluster::parallel::set_num_threads(nt);
+        fragments_t fragments(n);
+        std::vector<std::vector<std::pair<int, int> > > pending(nt);
+        auto block = [&](int t, int nt) { return cluster::parallel::block_begin(0, nb, t, nt); };
+        cluster::parallel::run([&](int t, int nt) {
+          run_collector<policy_t, fragments_t> runs(fragments, pending[t],
+            (block(t, nt) + dim - 1) / dim, (block(t + 1, nt) + dim - 1) / dim);
+          for (int b = block(t, nt); b < block(t + 1, nt); ++b)
+            if (bonds[b]) runs.add(lattice.source(b), lattice.target(b));
+          runs.flush();
+        });
+        cluster::parallel::run([&](int t, int) { unify_batch<policy_t>(fragments, pending[t]); });
+        update_weight<policy_t>(fragments);
+        int nc = assign_id(fragments);
+        // cluster id should be a one-to-one map of that of the reference
+        bool m = (nc == nc_s);
+        std::vector<int> map(nc, -1), inv(nc, -1);
+        for (int s = 0; m && s < n; ++s) {
+          int c = fragments[s].id();
+          int c_s = reference[s].id();
+          m = (map[c] < 0 || map[c] == c_s) && (inv[c_s] < 0 || inv[c_s] == c);
+          map[c] = c_s;
+          inv[c_s] = c;
+        }
+        for (int s = 0; m && s < n; ++s)
+          if (fragments[s].is_root())
+            m = (fragments[s].weight() == weight_s[map[fragments[s].id()]]);
+        std::size_t np = 0;
+        for (auto const& pt : pending) np += pt.size();
+        std::clog << name << ": number of threads = " << nt << ", bonds unified = " << np
+                  << ", number of clusters = " << nc_s << ", " << nc << ", "
+                  << (m ? "identical" : "different") << std::endl;
+        match = match && m;
+      }
+    });
+  }
+  if (!match) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  return 0;
+}
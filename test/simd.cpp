@@ -0,0 +1,96 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check vectorized root counting, id assignment and id copy against scalar version, flattening,
+// and the size limit of vectorized kernels (32-bit offsets)
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <random>
+#include "cluster/union_find.hpp"
+
+template<typename FRAGMENTS>
+bool test(std::vector<int> const& source, std::vector<int> const& target, int start, int n) {
+  using namespace cluster::union_find;
+  typedef raw_nodes<FRAGMENTS> raw;
+  int size = 0;
+  for (std::size_t b = 0; b < source.size(); ++b)
+    size = std::max(size, std::max(source[b], target[b]) + 1);
+
+  // deep trees without path compression
+  FRAGMENTS fragments(size);
+  for (std::size_t b = 0; b < source.size(); ++b)
+    unify<link_by_index>(fragments, source[b], target[b]);
+  FRAGMENTS fragments_s(fragments);
+
+  int nc_s = cluster::simd::count_root_scalar(raw::parent(fragments_s), raw::stride, start, n);
+  int nc_v = count_root(fragments, start, n);
+  int nid_s = cluster::simd::set_id_scalar(raw::parent(fragments_s), raw::id(fragments_s),
+                                           raw::stride, start, n, 7);
+  int nid_v = set_id(fragments, start, n, 7);
+  cluster::simd::copy_id_scalar(raw::parent(fragments_s), raw::id(fragments_s), raw::stride,
+                                start, n);
+  copy_id(fragments, start, n);
+  bool id_match = true;
+  for (int i = start; i < start + n; ++i)
+    id_match = id_match && (fragments_s[i].id() == fragments[i].id());
+
+  std::vector<int> root_s(size);
+  for (int i = 0; i < size; ++i) root_s[i] = root_index(fragments, i);
+  flatten(fragments);
+  bool flat = true;
+  for (int i = 0; i < size; ++i)
+    flat = flat && (fragments[i].is_root() ? (root_s[i] == i) :
+                    (fragments[i].parent() == root_s[i]));
+
+  std::clog << "range = [" << start << ", " << start + n << "), "
+            << "number of roots = " << nc_s << ", " << nc_v << ", "
+            << "cluster id = " << (id_match ? "match" : "mismatch") << ", "
+            << "flatten = " << (flat ? "ok" : "failed") << std::endl;
+  if (nc_s != nc_v || nid_s != nid_v || !id_match || !flat) {
+    std::cerr << "result mismatch\n";
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  std::clog << "AVX2 kernel = " << (cluster::simd::has_avx2() ? "enabled" : "disabled")
+            << std::endl;
+  int size = 100003;
+  std::mt19937 eng(12345);
+  std::uniform_int_distribution<int> r_node(0, size - 1);
+  std::vector<int> source(size / 2), target(size / 2);
+  for (std::size_t b = 0; b < source.size(); ++b) {
+    source[b] = r_node(eng);
+    target[b] = r_node(eng);
+  }
+  source.push_back(size - 1);
+  target.push_back(size - 1);
+
+  // ranges with unaligned head and tail
+  int ranges[][2] = { { 0, size }, { 3, size - 10 }, { 5, 6 }, { 1000, 8 } };
+  for (auto& r : ranges) {
+    if (!test<std::vector<cluster::union_find::node> >(source, target, r[0], r[1])) return 127;
+    if (!test<cluster::union_find::forest>(source, target, r[0], r[1])) return 127;
+  }
+
+  // node (i + 1) * stride - 1 should be addressable by int for the last node i
+  if (!cluster::simd::fits((std::size_t(1) << 30) - 1, 2) ||
+      cluster::simd::fits(std::size_t(1) << 30, 2) ||
+      !cluster::simd::fits((std::size_t(1) << 31) - 1, 1) ||
+      cluster::simd::fits(std::size_t(1) << 31, 1)) {
+    std::cerr << "wrong size limit of vectorized kernels\n";
+    return 127;
+  }
+  return 0;
+}
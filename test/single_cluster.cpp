@@ -0,0 +1,93 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that single-cluster growth, sequential and by parallel frontier expansion with any number
+// of threads, gives the cluster of union-find containing the seed for a fixed set of active bonds,
+// and that the visited marks of a cluster do not leak into the next one
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+#include <lattice/graph.hpp>
+#include "cluster/single_cluster.hpp"
+#include "cluster/union_find.hpp"
+
+int main() {
+  using namespace cluster::union_find;
+  int seed = 2357;
+  int length = 64;
+  int max_threads = 4;
+  int samples = 256;
+
+  // square lattice slightly above the percolation threshold
+  auto lattice = lattice::graph::simple(2, length);
+  int n = lattice.num_sites();
+  int nb = lattice.num_bonds();
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<std::vector<std::pair<int, int> > > adjacent(n); // (neighbor, bond)
+  std::vector<int> bonds(nb);
+  for (int b = 0; b < nb; ++b) {
+    bonds[b] = (r_uniform01(eng) < 0.55);
+    adjacent[lattice.source(b)].push_back(std::make_pair(lattice.target(b), b));
+    adjacent[lattice.target(b)].push_back(std::make_pair(lattice.source(b), b));
+  }
+
+  // reference
+  std::vector<node> reference(n);
+  for (int b = 0; b < nb; ++b)
+    if (bonds[b]) unify(reference, lattice.source(b), lattice.target(b));
+  assign_id(reference);
+
+  auto neighbors = [&](int s, auto const& f) { for (auto const& a : adjacent[s]) f(a.first); };
+  auto bond_index = [&](int s, int t) {
+    for (auto const& a : adjacent[s])
+      if (a.first == t) return a.second;
+    return -1;
+  };
+  cluster::single_cluster wolff(n);
+  bool match = true;
+  for (int nt = 1; nt <= max_threads; ++nt) {
+    cluster::parallel::set_num_threads(nt);
+    for (int k = 0; k < samples; ++k) {
+      int s0 = n * r_uniform01(eng);
+      // in sequential growth, bond() is called at most once per bond
+      std::vector<int> tested(nb, 0);
+      bool once = true;
+      auto bond = [&](int s, int t, int) {
+        int b = bond_index(s, t);
+        if (nt == 1) once = once && (tested[b]++ == 0);
+        return bonds[b] != 0;
+      };
+      std::size_t c = (nt == 1) ? wolff.grow(s0, neighbors, bond) :
+        wolff.grow_parallel(s0, neighbors, bond, 1);
+      std::vector<int> members(wolff.members());
+      std::sort(members.begin(), members.end());
+      std::vector<int> expected;
+      for (int s = 0; s < n; ++s)
+        if (reference[s].id() == reference[s0].id()) expected.push_back(s);
+      bool m = once && (c == expected.size()) && (members == expected);
+      if (!m)
+        std::cerr << "threads = " << nt << ", seed site = " << s0 << ": cluster of size " << c
+                  << " instead of " << expected.size() << std::endl;
+      match = match && m;
+    }
+  }
+  std::clog << "checked " << samples * max_threads << " clusters\n";
+
+  if (!match) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  return 0;
+}
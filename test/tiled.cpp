@@ -0,0 +1,78 @@
+/*****************************************************************************
+*
+* Cluster-MC: Cluster Algorithm Monte Carlo Methods
+*
+* Copyright (C) 1997-2019 by Synge Todo <wistaria@phys.s.u-tokyo.ac.jp>
+*
+* Distributed under the Boost Software License, Version 1.0. (See accompanying
+* file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*
+*****************************************************************************/
+
+// check that tiled_labeler gives the same clusters and cluster sizes as serial unify for various
+// tile sizes and numbers of threads
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <lattice/graph.hpp>
+#include "cluster/tiled_labeler.hpp"
+
+int main() {
+  using namespace cluster::union_find;
+  int seed = 2357;
+  int length = 128;
+  int max_threads = 4;
+
+  // square lattice at the percolation threshold
+  auto lattice = lattice::graph::simple(2, length);
+  int n = lattice.num_sites();
+  int nb = lattice.num_bonds();
+  std::mt19937 eng(seed);
+  std::uniform_real_distribution<> r_uniform01;
+  std::vector<int> bonds(nb);
+  for (auto& bond : bonds) bond = (r_uniform01(eng) < 0.5);
+
+  // serial reference
+  std::vector<node> fragments(n);
+  for (int b = 0; b < nb; ++b)
+    if (bonds[b]) unify(fragments, lattice.source(b), lattice.target(b));
+  update_weight(fragments);
+  int nc_s = assign_id(fragments);
+  std::vector<int> weight_s(nc_s);
+  for (int s = 0; s < n; ++s)
+    if (fragments[s].is_root()) weight_s[fragments[s].id()] = fragments[s].weight();
+
+  bool match = true;
+  for (int tile_size : { 1, 7, 256, 1000, 4096, n }) {
+    tiled_labeler<> labeler(lattice, tile_size);
+    for (int nt = 1; nt <= max_threads; ++nt) {
+      cluster::parallel::set_num_threads(nt);
+      int nc = labeler.label([&](int b) { return bonds[b] != 0; });
+      // cluster id should be a one-to-one map of that of the reference
+      bool m = (nc == nc_s);
+      std::vector<int> map(nc, -1), inv(nc, -1);
+      for (int s = 0; m && s < n; ++s) {
+        int c = labeler.cluster_id(s);
+        int c_s = fragments[s].id();
+        m = (c >= 0 && c < nc) && (map[c] < 0 || map[c] == c_s) &&
+          (inv[c_s] < 0 || inv[c_s] == c);
+        if (m) {
+          map[c] = c_s;
+          inv[c_s] = c;
+        }
+      }
+      for (int c = 0; m && c < nc; ++c) m = (labeler.cluster_weight(c) == weight_s[map[c]]);
+      std::clog << "tile size = " << tile_size << ", number of tiles = " << labeler.num_tiles()
+                << ", boundary sites = " << labeler.num_boundary_sites()
+                << ", number of threads = " << nt << ", number of clusters = " << nc_s << ", "
+                << nc << ", " << (m ? "identical" : "different") << std::endl;
+      match = match && m;
+    }
+  }
+  if (!match) {
+    std::cerr << "result mismatch\n";
+    return 127;
+  }
+  return 0;
+}